@@ -4,6 +4,12 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++17
 
+# the evaluation loops rely on auto-vectorization, which gcc and clang only do fully at -O3
+!msvc {
+    QMAKE_CXXFLAGS_RELEASE -= -O2
+    QMAKE_CXXFLAGS_RELEASE += -O3
+}
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
@@ -17,15 +23,28 @@ SOURCES += \
 HEADERS += \
     cpu.h \
     cpumctstt.h \
+    dfpn.h \
+    endgame.h \
+    evalcache.h \
     game.h \
+    gamedatabase.h \
+    inference.h \
     mainwindow.h \
+    mappedfile.h \
     mctscpu.h \
     negamaxcpu.h \
     network.h \
+    openingbook.h \
     pitch.h \
     random.h \
     rl.h \
+    sample.h \
+    samplefile.h \
+    trainer.h \
     secondwindow.h \
+    snapshot.h \
+    stoptoken.h \
+    timemanager.h \
     utils.h \
     workerthread.h
 
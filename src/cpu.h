@@ -8,9 +8,13 @@
 
 #include "game.h"
 #include "random.h"
+#include "stoptoken.h"
 
 #include <string>
 #include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <cstring>
 
 using namespace std;
 
@@ -46,6 +50,14 @@ public:
         return player;
     }
 
+    // the running search returns its best move so far, stopToken->reset() before the next one
+    void stop() {
+        stopToken->stop();
+    }
+
+    StopToken ownStopToken;
+    StopToken *stopToken = &ownStopToken;
+
     virtual ~ICpu() { }
 protected:
     Game *game;
@@ -65,16 +77,21 @@ protected:
 
     uint64_t hashPaths(vector<Path> &paths) {
         uint64_t output = 0;
-        for (auto &path : paths) {  // taken from xorshift64
-            uint64_t h = 573453117ULL * path.hashCode;
-            h ^= h << 13;
-            h ^= h >> 7;
-            h ^= h << 17;
-            output += h;
+        for (auto &path : paths) {
+            output += hashPath(path);
         }
         return output;
     }
 
+    // hashPaths of a single edge, so a path's hash can be kept up to date edge by edge
+    uint64_t hashPath(const Path &path) {
+        uint64_t h = 573453117ULL * path.hashCode; // taken from xorshift64
+        h ^= h << 13;
+        h ^= h >> 7;
+        h ^= h << 17;
+        return h;
+    }
+
     vector<Path> makeMove(string &move) {
         vector<Path> paths;
         paths.reserve(move.size());
@@ -119,8 +136,65 @@ protected:
 
 class TTEntry {
 public:
-    int value;
+    float value;
     int flag;
+    int depth;
+};
+
+// Search results by position key (Pitch::getKey), shared by the threads of one search without
+// locks, like EvalCache: value, depth and flag in one word, stored with key^word, so a torn
+// entry is just a miss. One entry per bucket, replaced unless it holds the same position searched
+// deeper.
+class TranspositionTable {
+public:
+    explicit TranspositionTable(size_t megabytes) {
+        size_t count = 1;
+        while (2 * count * sizeof(Entry) <= (megabytes << 20)) count *= 2;
+        entries = count;
+        table.reset(new Entry[entries]);
+        clear();
+    }
+
+    void clear() {
+        for (size_t i=0; i < entries; i++) {
+            table[i].check.store(0, memory_order_relaxed);
+            table[i].data.store(0, memory_order_relaxed);
+        }
+    }
+
+    bool probe(uint64_t key, TTEntry & entry) {
+        Entry & e = table[key & (entries-1)];
+        uint64_t data = e.data.load(memory_order_relaxed);
+        uint64_t check = e.check.load(memory_order_relaxed);
+        if ((data & VALID) == 0 || (check ^ data) != key) return false;
+        uint32_t bits = (uint32_t)data;
+        memcpy(&entry.value, &bits, sizeof(float));
+        entry.depth = (data >> 32) & 255;
+        entry.flag = (data >> 40) & 3;
+        return true;
+    }
+
+    void store(uint64_t key, float value, int depth, int flag) {
+        Entry & e = table[key & (entries-1)];
+        uint64_t old = e.data.load(memory_order_relaxed);
+        if ((old & VALID) != 0 && (e.check.load(memory_order_relaxed) ^ old) == key && (int)((old >> 32) & 255) > depth) return;
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(float));
+        uint64_t data = VALID | ((uint64_t)flag << 40) | ((uint64_t)(depth & 255) << 32) | bits;
+        e.data.store(data, memory_order_relaxed);
+        e.check.store(key ^ data, memory_order_relaxed);
+    }
+
+private:
+    static const uint64_t VALID = 1ULL << 42;
+
+    struct Entry {
+        atomic<uint64_t> check;
+        atomic<uint64_t> data;
+    };
+
+    size_t entries;
+    unique_ptr<Entry[]> table;
 };
 
 
@@ -10,6 +10,11 @@
 #include "random.h"
 #include "negamaxcpu.h"
 #include "mctscpu.h"
+#include "timemanager.h"
+#include "snapshot.h"
+#include "stoptoken.h"
+#include "endgame.h"
+#include "dfpn.h"
 
 using namespace std;
 using namespace std::chrono;
@@ -75,9 +80,11 @@ public:
 class CpuMctsTTRWorker {
 public:
     int id = 0;
-    Network *agent;
+    INetwork *agent;
+    EvalContext evalContext;
     Random ran;
     const int SIZE;
+    int partition; // nodes of each worker, see CpuMctsTTRParallel::search
     int moveLimit = 250;
 
     void shuffle(vector<int> &ints) {
@@ -115,13 +122,17 @@ public:
     int & games;
     int & maxLevel;
     bool & provenEnd;
+    StopToken *stopToken = nullptr;
+    StopToken *solvedToken = nullptr;
+    TimeManager & timeManager;
+    int visitLimit = 0;
 
     int jumpTo(int index) {
         return (91153 * index + 5) & (SIZE-1);
     }
 
     int getMove(int parent, int player, const string & m) {
-        int index = (id*SIZE/8) + ccc;
+        int index = (id*partition) + ccc;
         auto move = &movesPool[index];
         move->lock = &spinLocks[jumpTo(index)];
         move->index = index;
@@ -135,12 +146,12 @@ public:
         move->terminal = false;
         move->childStart = -1;
         move->childrenSize = -1;
-        ccc = ((ccc+1)&((SIZE/8)-1));
+        ccc = ((ccc+1)&(partition-1));
         return move->index;
     }
 
-    explicit CpuMctsTTRWorker(int SIZE, vector<MoveMctsTTR2> & movesPool, mutex & globalLock, vector<SpinLock> & spinLocks, int & games, int &maxLevel, bool &provenEnd) :
-        SIZE(SIZE), movesPool(movesPool), globalLock(globalLock), spinLocks(spinLocks), games(games), maxLevel(maxLevel), provenEnd(provenEnd) {
+    explicit CpuMctsTTRWorker(int SIZE, vector<MoveMctsTTR2> & movesPool, mutex & globalLock, vector<SpinLock> & spinLocks, int & games, int &maxLevel, bool &provenEnd, TimeManager &timeManager) :
+        SIZE(SIZE), partition(SIZE/8), movesPool(movesPool), globalLock(globalLock), spinLocks(spinLocks), games(games), maxLevel(maxLevel), provenEnd(provenEnd), timeManager(timeManager) {
     }
 
     void setPlayer(int player) {
@@ -155,24 +166,65 @@ public:
         this->game = game;
     }
 
-    void doWork(high_resolution_clock::time_point start, long timeInMicro, pair<int,int> & childs) {
-        long duration = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    void doWork(pair<int,int> & childs) {
         game = new Game(*(this->game));
         Game copy = *game;
-        while (!provenEnd && duration < timeInMicro && ccc+moveLimit < (SIZE/8)) {
+        int iterations = 0;
+        while (!provenEnd && !stopToken->stopped() && !solvedToken->stopped() && !timeManager.done() && ccc+moveLimit < partition) {
             globalLock.lock();
             int g = games+1;
             globalLock.unlock();
+            if (visitLimit > 0 && g > visitLimit) break;
             selectAndExpand(childs.first, childs.second, g+1,0);
             globalLock.lock();
             games++;
             globalLock.unlock();
             *game = copy;
-            duration = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+            if (id == 0 && (++iterations & 15) == 0) checkTime(childs);
+        }
+        // an infinite search with its share of the pool full keeps its result until stopped
+        while (timeManager.infinite() && !provenEnd && !stopToken->stopped() && !solvedToken->stopped()) {
+            this_thread::sleep_for(milliseconds(5));
         }
         delete game;
     }
 
+    // Thread 0 decides when the search ends. At the soft limit it stops unless the move that
+    // would be played is not the most visited one (then it goes on up to the hard limit), and
+    // it stops before when the runner-up cannot catch up in the remaining time.
+    void checkTime(pair<int,int> & childs) {
+        if (childs.second <= 1 && timeManager.earlyStop) {
+            timeManager.finish();
+            return;
+        }
+        float leader = -2 * INF, runnerUp = -2 * INF;
+        int leaderIndex = -1, runnerUpGames = 0;
+        int mostVisited = -1, mostGames = -1;
+        for (int m=0; m < childs.second; m++) {
+            int i = (childs.first+m) & (movesPool.size()-1);
+            auto & c = movesPool[i];
+            float score = c.heuristic + log(c.games+3);
+            if (score > leader) {
+                runnerUp = leader;
+                runnerUpGames = leaderIndex == -1 ? 0 : movesPool[leaderIndex].games;
+                leader = score;
+                leaderIndex = i;
+            } else if (score > runnerUp) {
+                runnerUp = score;
+                runnerUpGames = c.games;
+            }
+            if (c.games > mostGames) {
+                mostGames = c.games;
+                mostVisited = i;
+            }
+        }
+        if (timeManager.pastSoft()) {
+            if (leaderIndex == mostVisited) timeManager.finish();
+        } else if (timeManager.canStopEarly(games, leader, runnerUp, runnerUpGames)) {
+            timeManager.finish();
+        }
+    }
+
 private:
     int player;
     Game *game;
@@ -205,6 +257,7 @@ private:
         talia.push_back(make_pair(game->pitch.ball, vector<Path>()));
 
 
+        bool solvable = endgame.prepare(game->pitch);
         vector<int> konceEdges;
         bool check = true;
         if (!game->pitch.onlyOneEmpty()) {
@@ -215,7 +268,11 @@ private:
         int loop = 0;
 
         vector<int> tsBase = agent->type == 0 ? game->getTuplesEdgesBase() : agent->type == 1 ? game->getTuplesEdgesBase3() : game->getTuplesEdgesBase4();
-        agent->cacheScore(tsBase,id);
+        agent->cacheScore(tsBase,evalContext);
+        evalBatch.clear();
+        batchChildren.clear();
+        batchKeys.clear();
+        int cacheHits = 0;
 
         while (!talia.empty() && childrenSize < moveLimit) {
             pair<int, vector<Path>> v_paths;
@@ -256,6 +313,8 @@ private:
                     game->pitch.ball = n;
 
                     float score = 0;
+                    bool evaluated = false;
+                    int solved;
                     if (goal != NONE) {
                         if (goal == player) {
                             score = MIN_GOAL + game->rounds;
@@ -281,6 +340,8 @@ private:
                                 score = MAX_ONE_EMPTY - game->rounds;
                             } else if (game->pitch.onlyTwoEmpty()) {
                                 score = MIN_GOAL_ONE_EMPTY + game->rounds;
+                            } else if (solvable && (solved = endgame.solve(game->pitch, player == ONE ? TWO : ONE)) != ENDGAME_UNKNOWN) {
+                                score = solved == ENDGAME_LOSS ? MAX_SOLVED - game->rounds : MIN_SOLVED + game->rounds;
                             } else if (!alreadyBlocked && game->pitch.passNextDone2(t) && game->pitch.isCutOffFromOpponentGoal(player)) {
                                 score = MIN_CUTOFF + game->rounds;
                             } else if (!alreadyBlocking && game->pitch.passNextDone2(t) && game->pitch.isCutOffFromOpponentGoal(player == ONE ? TWO : ONE)) {
@@ -288,71 +349,73 @@ private:
                             } else {
                                 game->changePlayer();
                                 game->rounds++;
-                                // auto tuples = agent->type == 0 ? game->getTuplesEdges() : game->getTuplesEdges3();
-                                // float h = agent->getScore(tuples);
-                                // score = -h;
-
-                                tsDiff.clear();
-                                if (agent->type == 1) {
-                                    if (game->currentPlayer == ONE) {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
-                                        }
-                                        tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances(game->pitch.ball,distances);
-                                        tsDiff.push_back(316+distances[100]);
-                                        tsDiff.push_back(316+10+distances[103]);
-                                        tsDiff.push_back(336+n);
-                                    } else {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
-                                        }
-                                        tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances(game->pitch.ball,distances);
-                                        tsDiff.push_back(316+distances[103]);
-                                        tsDiff.push_back(316+10+distances[100]);
-                                        tsDiff.push_back(336+BALLS_MIRRORED[n]);
-                                    }
-                                } else if (agent->type == 2) {
-                                    if (game->currentPlayer == ONE) {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                uint64_t key = game->pitch.getKey(game->currentPlayer);
+                                float cached;
+                                if (agent->cache != nullptr && agent->cache->probe(key, cached)) {
+                                    score = -cached;
+                                    cacheHits++;
+                                } else {
+                                    tsDiff.clear();
+                                    if (agent->type == 1) {
+                                        if (game->currentPlayer == ONE) {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                            }
+                                            tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances(game->pitch.ball,distances);
+                                            tsDiff.push_back(316+distances[100]);
+                                            tsDiff.push_back(316+10+distances[103]);
+                                            tsDiff.push_back(336+n);
+                                        } else {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
+                                            }
+                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances(game->pitch.ball,distances);
+                                            tsDiff.push_back(316+distances[103]);
+                                            tsDiff.push_back(316+10+distances[100]);
+                                            tsDiff.push_back(336+BALLS_MIRRORED[n]);
                                         }
-                                        tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances2(game->pitch.ball,distances);
-                                        for (int i=0; i < 105; i++) {
-                                            tsDiff.push_back(316+10*i+distances[i]);
+                                    } else if (agent->type == 2) {
+                                        if (game->currentPlayer == ONE) {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                            }
+                                            tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances2(game->pitch.ball,distances);
+                                            for (int i=0; i < 105; i++) {
+                                                tsDiff.push_back(316+10*i+distances[i]);
+                                            }
+                                            tsDiff.push_back(1366+n);
+                                        } else {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
+                                            }
+                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances2(game->pitch.ball,distances);
+                                            for (int i=0; i < 105; i++) {
+                                                tsDiff.push_back(316+10*i+distances[BALLS_MIRRORED[i]]);
+                                            }
+                                            tsDiff.push_back(1366+BALLS_MIRRORED[n]);
                                         }
-                                        tsDiff.push_back(1366+n);
                                     } else {
+                                        int N = game->currentPlayer == ONE ? 0 : 415;
                                         for (auto & p : paths) {
-                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
-                                        }
-                                        tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances2(game->pitch.ball,distances);
-                                        for (int i=0; i < 105; i++) {
-                                            tsDiff.push_back(316+10*i+distances[BALLS_MIRRORED[i]]);
+                                            tsDiff.push_back(N+ALL_EDGES_INDEXES[p.a*105+p.b]);
                                         }
-                                        tsDiff.push_back(1366+BALLS_MIRRORED[n]);
-                                    }
-                                } else {
-                                    int N = game->currentPlayer == ONE ? 0 : 415;
-                                    for (auto & p : paths) {
-                                        tsDiff.push_back(N+ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                        tsDiff.push_back(N+ALL_EDGES_INDEXES[105*t+n]);
+                                        tsDiff.push_back(N+316+n);
                                     }
-                                    tsDiff.push_back(N+ALL_EDGES_INDEXES[105*t+n]);
-                                    tsDiff.push_back(N+316+n);
-                                }
 
-                                float h2 = agent->getScoreDiff({},tsDiff,id);
-                                score = -h2;
-                                // if (abs(h-h2) > 0.01f) {
-                                //     cout << h << " vs " << h2 << endl;
-                                // }
+                                    // scored below together with the other children
+                                    evalBatch.add(tsDiff);
+                                    evaluated = true;
+                                    batchKeys.push_back(key);
+                                }
 
                                 game->changePlayer();
                                 game->rounds--;
@@ -368,6 +431,7 @@ private:
                     childrenSize++;
                     auto & move = movesPool[childIndex];
                     move.heuristic = score;
+                    if (evaluated) batchChildren.push_back(childIndex);
                     if (score > 100) {
                         move.heuristic = score;
                         move.score = 1;
@@ -393,11 +457,26 @@ private:
             game->pitch.removeEdge(konceEdges[2 * i], konceEdges[2 * i + 1]);
         }
 
+        agent->getScoresDiff(evalBatch,evalContext);
+        for (int i=0; i < evalBatch.size(); i++) {
+            movesPool[batchChildren[i]].heuristic = -evalBatch.scores[i];
+        }
+        if (agent->cache != nullptr) {
+            for (int i=0; i < evalBatch.size(); i++) {
+                agent->cache->store(batchKeys[i], evalBatch.scores[i]);
+            }
+            agent->cache->addStats(evalBatch.size() + cacheHits, cacheHits);
+        }
+
         return make_pair(childStart,childrenSize);
     }
 
     vector<int> tsDiffBase;
     vector<int> tsDiff;
+    EvalBatch evalBatch;
+    EndgameSolver endgame;
+    vector<int> batchChildren;
+    vector<uint64_t> batchKeys;
 
     vector<int> indexes;
     void selectAndExpand(int childStart, int childSize, int games, int level) {
@@ -500,9 +579,11 @@ private:
 class CpuMctsTTRParallel {
 public:
     int id = 0;
-    Network *agent;
+    INetwork *agent;
+    EvalContext evalContext;
     Random ran;
     const int SIZE;
+    int partition; // nodes of each worker, see CpuMctsTTRParallel::search
     int moveLimit = 250;
 
     void shuffle(vector<int> &ints) {
@@ -541,13 +622,32 @@ public:
     int games;
     int maxLevel;
     bool provenEnd;
+    StopToken ownStopToken;
+    StopToken *stopToken = &ownStopToken;
+    int visitLimit = 0;
+    TimeManager timeManager;
+
+    // published every snapshotInterval ms while searching (0 only at the end)
+    SnapshotBuffer snapshots;
+    long snapshotInterval = 0;
+    int snapshotLines = 5;
+    atomic<int> searches{0};
+
+    vector<MoveMctsTTR2*> rootMoves;
+
+    // df-pn in one more thread while the workers search; a proven win whose turn is among the
+    // root moves ends the search and marks it won, one cut off by moveLimit is added to them
+    // when the search ends. solver is also used alone by the engine's solve command.
+    bool solverThread = false;
+    DfpnSolver solver = DfpnSolver(32);
+    int solverResult = DFPN_UNKNOWN;
 
     int jumpTo(int index) {
         return (91153 * index + 5) & (SIZE-1);
     }
 
     int getMove(int parent, int player, const string & m) {
-        int index = (id*SIZE/8) + ccc;
+        int index = (id*partition) + ccc;
         auto move = &movesPool[index];
         move->lock = &spinLocks[jumpTo(index)];
         move->index = index;
@@ -561,14 +661,14 @@ public:
         move->terminal = false;
         move->childStart = -1;
         move->childrenSize = -1;
-        ccc = ((ccc+1)&((SIZE/8)-1));
+        ccc = ((ccc+1)&(partition-1));
         return move->index;
     }
 
-    explicit CpuMctsTTRParallel(int SIZE = 4194304) : SIZE(SIZE) {
+    explicit CpuMctsTTRParallel(int SIZE = 4194304) : SIZE(SIZE), partition(SIZE/8) {
         workers.reserve(8);
         for (int i=0; i < 8; i++) {
-            CpuMctsTTRWorker* worker = new CpuMctsTTRWorker(SIZE,movesPool,globalLock,spinLocks,games,maxLevel,provenEnd);
+            CpuMctsTTRWorker* worker = new CpuMctsTTRWorker(SIZE,movesPool,globalLock,spinLocks,games,maxLevel,provenEnd,timeManager);
             workers.push_back(worker);
         }
     }
@@ -589,7 +689,7 @@ public:
         this->game = game;
     }
 
-    void doWork(chrono::high_resolution_clock::time_point start, long timeInMicro, pair<int,int> & childs, int id) {
+    void doWork(pair<int,int> & childs, int id) {
         auto & worker = workers[id];
         worker->agent = agent;
         worker->setGame(game);
@@ -600,15 +700,67 @@ public:
         worker->C = C;
         worker->Croot = Croot;
         worker->moveLimit = moveLimit;
+        worker->partition = partition;
+        worker->visitLimit = visitLimit;
+        worker->stopToken = stopToken;
+        worker->solvedToken = &solvedToken;
         if (id == 0) worker->ccc = ccc;
         else worker->ccc = 0;
-        worker->doWork(start,timeInMicro,childs);
+        worker->doWork(childs);
+        runningWorkers--;
     }
 
     stringstream ss;
 
+    // the running search returns its best move so far, stopToken->reset() before the next one
+    void stop() {
+        stopToken->stop();
+    }
+
+    int getNodes(int th) {
+        int cccSum = 0;
+        for (int i=0; i < th; i++) cccSum += workers[i]->ccc;
+        return cccSum;
+    }
+
+    float getWinRate(const MoveMctsTTR2 *m) {
+        float h = 0.5f + (m->score / (m->games==0?1:m->games)) / 2.0f;
+        if (m->games == 0) h = 0.5f + (m->heuristic / (m->games==0?1:m->games)) / 2.0f;
+        if (m->terminal) h = m->heuristic > 100 ? 1 : 0;
+        return round(10000 * h) / 100.0f;
+    }
+
+    // follows the most promising replies below the given root move
+    string getPrincipalVariation(const MoveMctsTTR2 *m, int maxLength = 8) {
+        string pv = m->move;
+        for (int i=1; i < maxLength && m->childrenSize > 0; i++) {
+            const MoveMctsTTR2 *best = nullptr;
+            for (int c=0; c < m->childrenSize; c++) {
+                const MoveMctsTTR2 *child = &movesPool[(m->childStart+c) & (movesPool.size()-1)];
+                if (best == nullptr || child->heuristic + log(child->games+3) > best->heuristic + log(best->games+3)) {
+                    best = child;
+                }
+            }
+            m = best;
+            pv += " " + m->move;
+        }
+        return pv;
+    }
+
     MoveMctsTTR2* getBestMove(long timeInMicro, int th, bool print = false) {
-        auto start = high_resolution_clock::now();
+        timeManager.startFixed(timeInMicro);
+        return search(th, print);
+    }
+
+    // with a game clock, the time manager decides how long to think
+    MoveMctsTTR2* getBestMoveClock(long remainingInMicro, long incrementInMicro, int movesToGo, int th) {
+        timeManager.startClock(remainingInMicro, incrementInMicro, movesToGo);
+        return search(th, false);
+    }
+
+    // the time manager has to be started before
+    MoveMctsTTR2* search(int th, bool print = false) {
+        int searchNumber = ++searches;
         vector<MoveMctsTTR2*> moves;
         pair<int,int> childs;
 
@@ -618,18 +770,57 @@ public:
         ccc = 0;
         ss.clear();
 
+        // every worker takes nodes from its own part of the pool, as few parts as the threads need
+        partition = SIZE;
+        while (partition > SIZE/8 && SIZE/partition < th) partition /= 2;
+
         if (moves.size() == 0) {
             childs = generateMoves(-1);
             moves = getMoves(childs.first, childs.second);
         }
 
+        Game solverGame;
+        StopToken solverStop;
+        thread solverWorker;
+        solverResult = DFPN_UNKNOWN;
+        int solvedMove = -1;
+        solvedToken.reset();
+        if (solverThread) {
+            solverGame = *game;
+            solver.stopToken = &solverStop;
+            solverWorker = thread([this, &solverGame, &moves, &solvedMove]() {
+                solverResult = solver.solve(solverGame);
+                if (solverResult != DFPN_WIN) return;
+                solvedMove = findSolved(moves, solverGame.pitch);
+                if (solvedMove >= 0) solvedToken.stop();
+            });
+        }
+
         vector<thread> threads; threads.reserve(th);
+        runningWorkers = th;
         for (int i=0; i < th; i++) {
-            threads.push_back(thread(&CpuMctsTTRParallel::doWork, this, start, timeInMicro, ref(childs), i));
+            threads.push_back(thread(&CpuMctsTTRParallel::doWork, this, ref(childs), i));
+        }
+        if (snapshotInterval > 0) {
+            long last = 0;
+            while (runningWorkers > 0) {
+                this_thread::sleep_for(milliseconds(min(snapshotInterval, 10L)));
+                long now = timeManager.elapsed() / 1000;
+                if (now - last >= snapshotInterval) {
+                    publishSnapshot(moves, searchNumber, th, false);
+                    last = now;
+                }
+            }
         }
         for (auto & t : threads) {
             t.join();
         }
+        if (solverWorker.joinable()) {
+            solverStop.stop();
+            solverWorker.join();
+            if (solverResult == DFPN_WIN) markSolved(moves, solvedMove);
+        }
+        publishSnapshot(moves, searchNumber, th, true);
 
         sort(moves.begin(),moves.end(), [](const MoveMctsTTR2 *a, const MoveMctsTTR2 *b) -> bool
              {
@@ -637,6 +828,7 @@ public:
                  float avg2 = b->heuristic + log(b->games+3);
                  return avg1 > avg2;
              });
+        rootMoves = moves;
 
         if (print)
             for (auto & m : moves) {
@@ -648,11 +840,7 @@ public:
         //                cout << "maxLevel: " << maxLevel << endl;
 
         for (auto & m : moves) {
-            float h = 0.5f + (m->score / (m->games==0?1:m->games)) / 2.0f;
-            if (m->games == 0) h = 0.5f + (m->heuristic / (m->games==0?1:m->games)) / 2.0f;
-            if (m->terminal) h = m->heuristic > 100 ? 1 : 0;
-            h = round(10000 * h) / 100.0f;
-            ss << m->move << ": " << h << "%" << endl;
+            ss << m->move << ": " << getWinRate(m) << "%" << endl;
         }
         // cout << "games: " << games << endl;
         // cout << "maxLevel: " << maxLevel << endl;
@@ -660,15 +848,10 @@ public:
         ss << "possible moves: " << moves.size() << endl;
         ss << "visits: " << games << endl;
         // ss << "expansions: " << expansions << endl;
-        int cccSum = 0;
-        for (int i=0; i < th; i++) cccSum += workers[i]->ccc;
-        ss << "nodes: " << cccSum << endl;
+        ss << "nodes: " << getNodes(th) << endl;
         ss << "maxLevel: " << maxLevel << endl;
-        float h = 0.5f + (moves[0]->score / (moves[0]->games==0?1:moves[0]->games)) / 2.0f;
-        if (moves[0]->games == 0) h = 0.5f + (moves[0]->heuristic / (moves[0]->games==0?1:moves[0]->games)) / 2.0f;
-        if (moves[0]->terminal) h = moves[0]->heuristic > 100 ? 1 : 0;
-        h = round(10000 * h) / 100.0f;
-        ss << "best move: " << moves[0]->move << ": " << h << "%" << endl;
+        if (agent->cache != nullptr) ss << "eval cache hits: " << round(agent->cache->hitRate()) << "%" << endl;
+        ss << "best move: " << moves[0]->move << ": " << getWinRate(moves[0]) << "%" << endl;
         ss << "-------------------------------------------------" << endl;
 
         return moves[0];
@@ -677,6 +860,71 @@ public:
 private:
     int player;
     Game *game;
+    atomic<int> runningWorkers{0};
+    StopToken solvedToken; // set by the solver thread once its win is a root move
+    MoveMctsTTR2 solvedRoot = MoveMctsTTR2(-1,-1,""); // its win when it isn't
+
+    // Index of the root move reaching the solver's position after its winning turn, -1 if move
+    // generation cut that move off. Paths differ, so positions are compared.
+    int findSolved(vector<MoveMctsTTR2*> & moves, Pitch & pitch) {
+        player_t opponent = game->currentPlayer == ONE ? TWO : ONE;
+        int ball = pitch.ball;
+        vector<Path> paths;
+        for (int i=0; i < (int)moves.size(); i++) {
+            paths.clear();
+            for (auto & c : moves[i]->move) {
+                int n = pitch.nextNode(pitch.ball, c);
+                paths.push_back(Path(pitch.ball, n));
+                pitch.addEdge(pitch.ball, n);
+                pitch.ball = n;
+            }
+            bool found = pitch.getKey(opponent) == solver.moveKey;
+            for (auto & path : paths) pitch.removeEdge(path.a, path.b);
+            pitch.ball = ball;
+            if (found) return i;
+        }
+        return -1;
+    }
+
+    // marks the solver's win, a missing one becomes an extra root move without children
+    void markSolved(vector<MoveMctsTTR2*> & moves, int solvedMove) {
+        MoveMctsTTR2 *m;
+        if (solvedMove >= 0) {
+            m = moves[solvedMove];
+        } else {
+            solvedRoot = MoveMctsTTR2(-1, game->currentPlayer, solver.move);
+            solvedRoot.lock = &spinLocks[0];
+            m = &solvedRoot;
+            moves.push_back(m);
+        }
+        m->terminal = true;
+        m->heuristic = MAX_SOLVED - game->rounds;
+        m->games = max(m->games, 1);
+        m->score = m->games;
+    }
+
+    // Reads the tree while the workers change it. Nodes are not reused during a search and
+    // children are only linked once complete, so the worst case is a slightly stale number.
+    void publishSnapshot(vector<MoveMctsTTR2*> moves, int searchNumber, int th, bool finished) {
+        sort(moves.begin(),moves.end(), [](const MoveMctsTTR2 *a, const MoveMctsTTR2 *b) -> bool
+             {
+                 return a->heuristic + log(a->games+3) > b->heuristic + log(b->games+3);
+             });
+        AnalysisSnapshot snapshot;
+        snapshot.search = searchNumber;
+        snapshot.finished = finished;
+        snapshot.time = timeManager.elapsed() / 1000;
+        snapshot.visits = games;
+        snapshot.nodes = getNodes(th);
+        snapshot.nps = snapshot.time > 0 ? 1000L * snapshot.visits / snapshot.time : 0;
+        snapshot.depth = maxLevel;
+        if (agent->cache != nullptr) snapshot.evalHits = round(agent->cache->hitRate());
+        snapshot.lines = min((int)moves.size(), min(snapshotLines, SNAPSHOT_LINES));
+        for (int i=0; i < snapshot.lines; i++) {
+            snapshot.setLine(i, moves[i]->move, getPrincipalVariation(moves[i]), getWinRate(moves[i]), moves[i]->games);
+        }
+        snapshots.publish(snapshot);
+    }
 
     vector<MoveMctsTTR2*> getMoves(int childStart, int childrenSize) {
         vector<MoveMctsTTR2*> moves; moves.reserve(childrenSize);
@@ -706,6 +954,7 @@ private:
         talia.push_back(make_pair(game->pitch.ball, vector<Path>()));
 
 
+        bool solvable = endgame.prepare(game->pitch);
         vector<int> konceEdges;
         bool check = true;
         if (!game->pitch.onlyOneEmpty()) {
@@ -716,9 +965,15 @@ private:
         int loop = 0;
 
         vector<int> tsBase = agent->type == 0 ? game->getTuplesEdgesBase() : agent->type == 1 ? game->getTuplesEdgesBase3() : game->getTuplesEdgesBase4();
-        agent->cacheScore(tsBase,id);
+        agent->cacheScore(tsBase,evalContext);
+        evalBatch.clear();
+        batchChildren.clear();
+        batchKeys.clear();
+        int cacheHits = 0;
 
         while (!talia.empty() && childrenSize < moveLimit) {
+            // a huge root must not eat the whole move time, the children found so far are enough
+            if (parent == -1 && childrenSize > 0 && (loop & 63) == 0 && (timeManager.pastHard() || stopToken->stopped())) break;
             pair<int, vector<Path>> v_paths;
             loop++;
             if ((loop & 15) == 0) {
@@ -757,6 +1012,8 @@ private:
                     game->pitch.ball = n;
 
                     float score = 0;
+                    bool evaluated = false;
+                    int solved;
                     if (goal != NONE) {
                         if (goal == player) {
                             score = MIN_GOAL + game->rounds;
@@ -782,6 +1039,8 @@ private:
                                 score = MAX_ONE_EMPTY - game->rounds;
                             } else if (game->pitch.onlyTwoEmpty()) {
                                 score = MIN_GOAL_ONE_EMPTY + game->rounds;
+                            } else if (solvable && (solved = endgame.solve(game->pitch, player == ONE ? TWO : ONE)) != ENDGAME_UNKNOWN) {
+                                score = solved == ENDGAME_LOSS ? MAX_SOLVED - game->rounds : MIN_SOLVED + game->rounds;
                             } else if (!alreadyBlocked && game->pitch.passNextDone2(t) && game->pitch.isCutOffFromOpponentGoal(player)) {
                                 score = MIN_CUTOFF + game->rounds;
                             } else if (!alreadyBlocking && game->pitch.passNextDone2(t) && game->pitch.isCutOffFromOpponentGoal(player == ONE ? TWO : ONE)) {
@@ -789,71 +1048,73 @@ private:
                             } else {
                                 game->changePlayer();
                                 game->rounds++;
-                                // auto tuples = agent->type == 0 ? game->getTuplesEdges() : game->getTuplesEdges3();
-                                // float h = agent->getScore(tuples);
-                                // score = -h;
-
-                                tsDiff.clear();
-                                if (agent->type == 1) {
-                                    if (game->currentPlayer == ONE) {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
-                                        }
-                                        tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances(game->pitch.ball,distances);
-                                        tsDiff.push_back(316+distances[100]);
-                                        tsDiff.push_back(316+10+distances[103]);
-                                        tsDiff.push_back(336+n);
-                                    } else {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
-                                        }
-                                        tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances(game->pitch.ball,distances);
-                                        tsDiff.push_back(316+distances[103]);
-                                        tsDiff.push_back(316+10+distances[100]);
-                                        tsDiff.push_back(336+BALLS_MIRRORED[n]);
-                                    }
-                                } else if (agent->type == 2) {
-                                    if (game->currentPlayer == ONE) {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                uint64_t key = game->pitch.getKey(game->currentPlayer);
+                                float cached;
+                                if (agent->cache != nullptr && agent->cache->probe(key, cached)) {
+                                    score = -cached;
+                                    cacheHits++;
+                                } else {
+                                    tsDiff.clear();
+                                    if (agent->type == 1) {
+                                        if (game->currentPlayer == ONE) {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                            }
+                                            tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances(game->pitch.ball,distances);
+                                            tsDiff.push_back(316+distances[100]);
+                                            tsDiff.push_back(316+10+distances[103]);
+                                            tsDiff.push_back(336+n);
+                                        } else {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
+                                            }
+                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances(game->pitch.ball,distances);
+                                            tsDiff.push_back(316+distances[103]);
+                                            tsDiff.push_back(316+10+distances[100]);
+                                            tsDiff.push_back(336+BALLS_MIRRORED[n]);
                                         }
-                                        tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances2(game->pitch.ball,distances);
-                                        for (int i=0; i < 105; i++) {
-                                            tsDiff.push_back(316+10*i+distances[i]);
+                                    } else if (agent->type == 2) {
+                                        if (game->currentPlayer == ONE) {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                            }
+                                            tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances2(game->pitch.ball,distances);
+                                            for (int i=0; i < 105; i++) {
+                                                tsDiff.push_back(316+10*i+distances[i]);
+                                            }
+                                            tsDiff.push_back(1366+n);
+                                        } else {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
+                                            }
+                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances2(game->pitch.ball,distances);
+                                            for (int i=0; i < 105; i++) {
+                                                tsDiff.push_back(316+10*i+distances[BALLS_MIRRORED[i]]);
+                                            }
+                                            tsDiff.push_back(1366+BALLS_MIRRORED[n]);
                                         }
-                                        tsDiff.push_back(1366+n);
                                     } else {
+                                        int N = game->currentPlayer == ONE ? 0 : 415;
                                         for (auto & p : paths) {
-                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
-                                        }
-                                        tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances2(game->pitch.ball,distances);
-                                        for (int i=0; i < 105; i++) {
-                                            tsDiff.push_back(316+10*i+distances[BALLS_MIRRORED[i]]);
+                                            tsDiff.push_back(N+ALL_EDGES_INDEXES[p.a*105+p.b]);
                                         }
-                                        tsDiff.push_back(1366+BALLS_MIRRORED[n]);
-                                    }
-                                } else {
-                                    int N = game->currentPlayer == ONE ? 0 : 415;
-                                    for (auto & p : paths) {
-                                        tsDiff.push_back(N+ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                        tsDiff.push_back(N+ALL_EDGES_INDEXES[105*t+n]);
+                                        tsDiff.push_back(N+316+n);
                                     }
-                                    tsDiff.push_back(N+ALL_EDGES_INDEXES[105*t+n]);
-                                    tsDiff.push_back(N+316+n);
-                                }
 
-                                float h2 = agent->getScoreDiff({},tsDiff,id);
-                                score = -h2;
-                                // if (abs(h-h2) > 0.01f) {
-                                //     cout << h << " vs " << h2 << endl;
-                                // }
+                                    // scored below together with the other children
+                                    evalBatch.add(tsDiff);
+                                    evaluated = true;
+                                    batchKeys.push_back(key);
+                                }
 
                                 game->changePlayer();
                                 game->rounds--;
@@ -869,6 +1130,7 @@ private:
                     childrenSize++;
                     auto & move = movesPool[childIndex];
                     move.heuristic = score;
+                    if (evaluated) batchChildren.push_back(childIndex);
                     if (score > 100) {
                         move.heuristic = score;
                         move.score = 1;
@@ -894,11 +1156,26 @@ private:
             game->pitch.removeEdge(konceEdges[2 * i], konceEdges[2 * i + 1]);
         }
 
+        agent->getScoresDiff(evalBatch,evalContext);
+        for (int i=0; i < evalBatch.size(); i++) {
+            movesPool[batchChildren[i]].heuristic = -evalBatch.scores[i];
+        }
+        if (agent->cache != nullptr) {
+            for (int i=0; i < evalBatch.size(); i++) {
+                agent->cache->store(batchKeys[i], evalBatch.scores[i]);
+            }
+            agent->cache->addStats(evalBatch.size() + cacheHits, cacheHits);
+        }
+
         return make_pair(childStart,childrenSize);
     }
 
     vector<int> tsDiffBase;
     vector<int> tsDiff;
+    EvalBatch evalBatch;
+    EndgameSolver endgame;
+    vector<int> batchChildren;
+    vector<uint64_t> batchKeys;
 };
 
 class MoveMctsTTR {
@@ -955,7 +1232,10 @@ public:
 class CpuMctsTTR3 {
 public:
     int id = 0;
-    Network *agent;
+    INetwork *agent;
+    StopToken ownStopToken;
+    StopToken *stopToken = &ownStopToken;
+    EvalContext evalContext;
     bool train = false;
     Random ran;
     const int SIZE;
@@ -1028,9 +1308,15 @@ public:
         this->game = game;
     }
 
+    // the running search returns its best move so far, stopToken->reset() before the next one
+    void stop() {
+        stopToken->stop();
+    }
+
     MoveMctsTTR *lastMove=nullptr;
     string lastOpponentMove = "";
     int found = 0;
+    float rootValue = 0; // value of the searched position for the player to move
     stringstream ss;
 
     MoveMctsTTR* getBestMove(long timeInMicro, bool print = false) {
@@ -1074,7 +1360,7 @@ public:
 
         long duration = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
         Game copy = *game;
-        while (!provenEnd && duration < timeInMicro) {
+        while (!provenEnd && duration < timeInMicro && !stopToken->stopped()) {
             selectAndExpand(childs.first, childs.second, games+1,0);
             games++;
             *game = copy;
@@ -1130,7 +1416,7 @@ public:
         }
 
         Game copy = *game;
-        while (!provenEnd && games < iterations) {
+        while (!provenEnd && games < iterations && !stopToken->stopped()) {
             selectAndExpand(childs.first, childs.second, games+1,0);
             games++;
             *game = copy;
@@ -1149,6 +1435,8 @@ public:
             }
         }
 
+        rootValue = moves[0]->terminal ? (moves[0]->heuristic > 0 ? 1 : -1) : moves[0]->heuristic;
+
         if (train && !moves[0]->terminal) {
             vector<double> values;
             for (auto & m : moves) {
@@ -1209,7 +1497,7 @@ public:
         }
 
         Game copy = *game;
-        while (!provenEnd && expansions < iterations && games < 20 * iterations) {
+        while (!provenEnd && expansions < iterations && games < 20 * iterations && !stopToken->stopped()) {
             selectAndExpand(childs.first, childs.second, games+1,0);
             games++;
             *game = copy;
@@ -1228,6 +1516,8 @@ public:
             }
         }
 
+        rootValue = moves[0]->terminal ? (moves[0]->heuristic > 0 ? 1 : -1) : moves[0]->heuristic;
+
         if (train && !moves[0]->terminal) {
             vector<double> values;
             for (auto & m : moves) {
@@ -1279,6 +1569,7 @@ private:
         talia.push_back(make_pair(game->pitch.ball, vector<Path>()));
 
 
+        bool solvable = endgame.prepare(game->pitch);
         vector<int> konceEdges;
         bool check = true;
         if (!game->pitch.onlyOneEmpty()) {
@@ -1289,7 +1580,11 @@ private:
         int loop = 0;
 
         vector<int> tsBase = agent->type == 0 ? game->getTuplesEdgesBase() : agent->type == 1 ? game->getTuplesEdgesBase3() : game->getTuplesEdgesBase4();
-        agent->cacheScore(tsBase,id);
+        agent->cacheScore(tsBase,evalContext);
+        evalBatch.clear();
+        batchChildren.clear();
+        batchKeys.clear();
+        int cacheHits = 0;
 
         while (!talia.empty() && childrenSize < moveLimit) {
             pair<int, vector<Path>> v_paths;
@@ -1330,6 +1625,8 @@ private:
                     game->pitch.ball = n;
 
                     float score = 0;
+                    bool evaluated = false;
+                    int solved;
                     if (goal != NONE) {
                         if (goal == player) {
                             score = MIN_GOAL + game->rounds;
@@ -1355,6 +1652,8 @@ private:
                                 score = MAX_ONE_EMPTY - game->rounds;
                             } else if (game->pitch.onlyTwoEmpty()) {
                                 score = MIN_GOAL_ONE_EMPTY + game->rounds;
+                            } else if (solvable && (solved = endgame.solve(game->pitch, player == ONE ? TWO : ONE)) != ENDGAME_UNKNOWN) {
+                                score = solved == ENDGAME_LOSS ? MAX_SOLVED - game->rounds : MIN_SOLVED + game->rounds;
                             } else if (!alreadyBlocked && game->pitch.passNextDone2(t) && game->pitch.isCutOffFromOpponentGoal(player)) {
                                 score = MIN_CUTOFF + game->rounds;
                             } else if (!alreadyBlocking && game->pitch.passNextDone2(t) && game->pitch.isCutOffFromOpponentGoal(player == ONE ? TWO : ONE)) {
@@ -1362,78 +1661,80 @@ private:
                             } else {
                                 game->changePlayer();
                                 game->rounds++;
-                                // auto tuples = agent->type == 0 ? game->getTuplesEdges() : game->getTuplesEdges3();
-                                // float h = agent->getScore(tuples);
-                                // score = -h;
-
-                                tsDiff.clear();
-                                if (agent->type == 1) {
-                                    if (game->currentPlayer == ONE) {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
-                                        }
-                                        tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances(game->pitch.ball,distances);
-                                        tsDiff.push_back(316+distances[100]);
-                                        tsDiff.push_back(316+10+distances[103]);
-                                        tsDiff.push_back(336+n);
-                                    } else {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
-                                        }
-                                        tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances(game->pitch.ball,distances);
-                                        tsDiff.push_back(316+distances[103]);
-                                        tsDiff.push_back(316+10+distances[100]);
-                                        tsDiff.push_back(336+BALLS_MIRRORED[n]);
-                                    }
-                                } else if (agent->type == 2) {
-                                    if (game->currentPlayer == ONE) {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
-                                        }
-                                        tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances(game->pitch.ball,distances);
-                                        for (int i=0; i < 105; i++) {
-                                            tsDiff.push_back(316+10*i+distances[i]);
-                                        }
-                                        tsDiff.push_back(1366+n);
-                                    } else {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
-                                        }
-                                        tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
-                                        vector<int> distances(105,9);
-                                        game->pitch.calculateDistances(game->pitch.ball,distances);
-                                        for (int i=0; i < 105; i++) {
-                                            tsDiff.push_back(316+10*i+distances[BALLS_MIRRORED[i]]);
-                                        }
-                                        tsDiff.push_back(1366+BALLS_MIRRORED[n]);
-                                    }
+                                uint64_t key = game->pitch.getKey(game->currentPlayer);
+                                float cached;
+                                if (agent->cache != nullptr && agent->cache->probe(key, cached)) {
+                                    score = -cached;
+                                    cacheHits++;
                                 } else {
-                                    if (game->currentPlayer == ONE) {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                    tsDiff.clear();
+                                    if (agent->type == 1) {
+                                        if (game->currentPlayer == ONE) {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                            }
+                                            tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances(game->pitch.ball,distances);
+                                            tsDiff.push_back(316+distances[100]);
+                                            tsDiff.push_back(316+10+distances[103]);
+                                            tsDiff.push_back(336+n);
+                                        } else {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
+                                            }
+                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances(game->pitch.ball,distances);
+                                            tsDiff.push_back(316+distances[103]);
+                                            tsDiff.push_back(316+10+distances[100]);
+                                            tsDiff.push_back(336+BALLS_MIRRORED[n]);
+                                        }
+                                    } else if (agent->type == 2) {
+                                        if (game->currentPlayer == ONE) {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                            }
+                                            tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances(game->pitch.ball,distances);
+                                            for (int i=0; i < 105; i++) {
+                                                tsDiff.push_back(316+10*i+distances[i]);
+                                            }
+                                            tsDiff.push_back(1366+n);
+                                        } else {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
+                                            }
+                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
+                                            vector<int> distances(105,9);
+                                            game->pitch.calculateDistances(game->pitch.ball,distances);
+                                            for (int i=0; i < 105; i++) {
+                                                tsDiff.push_back(316+10*i+distances[BALLS_MIRRORED[i]]);
+                                            }
+                                            tsDiff.push_back(1366+BALLS_MIRRORED[n]);
                                         }
-                                        tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
-                                        tsDiff.push_back(316+n);
                                     } else {
-                                        for (auto & p : paths) {
-                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
+                                        if (game->currentPlayer == ONE) {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(ALL_EDGES_INDEXES[p.a*105+p.b]);
+                                            }
+                                            tsDiff.push_back(ALL_EDGES_INDEXES[105*t+n]);
+                                            tsDiff.push_back(316+n);
+                                        } else {
+                                            for (auto & p : paths) {
+                                                tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[p.a*105+p.b]]);
+                                            }
+                                            tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
+                                            tsDiff.push_back(316+BALLS_MIRRORED[n]);
                                         }
-                                        tsDiff.push_back(EDGES_MIRRORED[ALL_EDGES_INDEXES[105*t+n]]);
-                                        tsDiff.push_back(316+BALLS_MIRRORED[n]);
                                     }
-                                }
 
-                                float h2 = agent->getScoreDiff({},tsDiff,id);
-                                score = -h2;
-                                // if (abs(h-h2) > 0.01f) {
-                                //     cout << h << " vs " << h2 << endl;
-                                // }
+                                    // scored below together with the other children
+                                    evalBatch.add(tsDiff);
+                                    evaluated = true;
+                                    batchKeys.push_back(key);
+                                }
 
                                 game->changePlayer();
                                 game->rounds--;
@@ -1449,6 +1750,7 @@ private:
                     childrenSize++;
                     auto & move = movesPool[childIndex];
                     move.heuristic = score;
+                    if (evaluated) batchChildren.push_back(childIndex);
                     if (score > 100) {
                         move.heuristic = score;
                         move.score = 1;
@@ -1474,11 +1776,26 @@ private:
             game->pitch.removeEdge(konceEdges[2 * i], konceEdges[2 * i + 1]);
         }
 
+        agent->getScoresDiff(evalBatch,evalContext);
+        for (int i=0; i < evalBatch.size(); i++) {
+            movesPool[batchChildren[i]].heuristic = -evalBatch.scores[i];
+        }
+        if (agent->cache != nullptr) {
+            for (int i=0; i < evalBatch.size(); i++) {
+                agent->cache->store(batchKeys[i], evalBatch.scores[i]);
+            }
+            agent->cache->addStats(evalBatch.size() + cacheHits, cacheHits);
+        }
+
         return make_pair(childStart,childrenSize);
     }
 
     vector<int> tsDiffBase;
     vector<int> tsDiff;
+    EvalBatch evalBatch;
+    EndgameSolver endgame;
+    vector<int> batchChildren;
+    vector<uint64_t> batchKeys;
 
     vector<int> indexes;
     void selectAndExpand(int childStart, int childSize, int games, int level) {
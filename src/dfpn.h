@@ -0,0 +1,284 @@
+#ifndef DFPN_H
+#define DFPN_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <chrono>
+#include <climits>
+#include "game.h"
+#include "endgame.h"
+#include "stoptoken.h"
+
+using namespace std;
+using namespace std::chrono;
+
+#define DFPN_INFINITY 100000000u
+#define DFPN_MOVES 2000 // distinct turns generated for a position
+
+#define DFPN_UNKNOWN 0
+#define DFPN_WIN 1
+#define DFPN_NO_WIN 2
+
+// Depth-first proof-number search for a forced win of the player to move. Nodes are positions at
+// the start of a turn, children are the distinct positions after one whole turn (bounces
+// included), generated on the pitch in place and undone. Proof and disproof numbers are kept
+// per position key in a table, from the point of view of the player to move (phi proves a win,
+// delta disproves it), so a node's phi is its children's smallest delta and its delta the sum of
+// their phis. Small regions are solved by EndgameSolver instead of searched.
+// Only the first DFPN_MOVES turns of a position are generated. That is enough for the attacker,
+// a position of the defender with more is given up as not won. So a win is always real while
+// "no win" only means none was found within the limits.
+class DfpnSolver {
+public:
+    string move; // winning turn after DFPN_WIN
+    uint64_t moveKey = 0; // key of the position after it
+    long nodes = 0;
+    StopToken *stopToken = nullptr;
+
+    explicit DfpnSolver(size_t megabytes) : megabytes(megabytes) {
+    }
+
+    // ends at the time or node limit (0 is none), or when the stop token is set
+    int solve(Game & game, long timeInMicro = LONG_MAX, long nodeLimit = 0) {
+        if (table.empty()) {
+            size_t count = 1;
+            while (2 * count * sizeof(Entry) <= (megabytes << 20)) count *= 2;
+            table.resize(count);
+        }
+        for (auto & entry : table) entry = Entry();
+        pitch = &game.pitch;
+        attacker = game.currentPlayer;
+        start = steady_clock::now();
+        this->timeInMicro = timeInMicro;
+        this->nodeLimit = nodeLimit;
+        nodes = 0;
+        aborted = false;
+        move.clear();
+
+        Entry root = search(0, DFPN_INFINITY, DFPN_INFINITY, attacker);
+        if (aborted) return DFPN_UNKNOWN;
+        if (root.phi != 0) return DFPN_NO_WIN;
+
+        // the root may have been solved without its children, generate them again
+        Frame & frame = frames[0];
+        solvable = endgame.prepare(*pitch);
+        generate(frame, attacker);
+        for (auto & child : frame.children) {
+            uint32_t phi, delta;
+            values(child, phi, delta);
+            if (delta != 0) continue;
+            int ball = pitch->ball;
+            for (int i=0; i < child.length; i++) {
+                int n = frame.path[child.start + i];
+                move += pitch->getDistanceChar(ball, n);
+                ball = n;
+            }
+            moveKey = child.key;
+            return DFPN_WIN;
+        }
+        return DFPN_UNKNOWN; // the winning child was pushed out of the table
+    }
+
+private:
+    struct Entry {
+        uint64_t key = 0;
+        uint32_t phi = 1;
+        uint32_t delta = 1;
+    };
+
+    // a turn from the frame's position, known if it ends the game, was solved on generation or
+    // has been searched (then phi and delta are what its last search returned)
+    struct Child {
+        uint64_t key;
+        int start;
+        int length;
+        bool known;
+        uint32_t phi;
+        uint32_t delta;
+    };
+
+    struct Frame {
+        vector<Child> children;
+        vector<int> path; // nodes of every child's turn
+    };
+
+    size_t megabytes;
+    vector<Entry> table;
+    deque<Frame> frames; // by depth, references stay valid as it grows
+    vector<vector<int>> neighbours; // by step within a turn
+    vector<int> turn;
+    unordered_set<uint64_t> seen;
+    EndgameSolver endgame;
+
+    Pitch *pitch;
+    player_t attacker;
+    steady_clock::time_point start;
+    long timeInMicro;
+    long nodeLimit;
+    bool aborted;
+    bool solvable;
+    bool overflow;
+
+    static uint32_t sum(uint32_t a, uint32_t b) {
+        return a + b >= DFPN_INFINITY ? DFPN_INFINITY : a + b;
+    }
+
+    Entry & lookup(uint64_t key) {
+        return table[key & (table.size()-1)];
+    }
+
+    Entry store(uint64_t key, uint32_t phi, uint32_t delta) {
+        Entry values = {key, phi, delta};
+        Entry & entry = lookup(key);
+        // keep solved entries, they cost the most to find again
+        if (entry.key != key && (entry.phi == 0 || entry.delta == 0) && phi != 0 && delta != 0) return values;
+        entry = values;
+        return values;
+    }
+
+    void values(Child & child, uint32_t & phi, uint32_t & delta) {
+        if (child.known) {
+            phi = child.phi;
+            delta = child.delta;
+            return;
+        }
+        Entry & entry = lookup(child.key);
+        if (entry.key == child.key) {
+            phi = entry.phi;
+            delta = entry.delta;
+        } else {
+            phi = 1;
+            delta = 1;
+        }
+    }
+
+    bool outOfTime() {
+        if (nodeLimit > 0 && nodes >= nodeLimit) return true;
+        if ((nodes & 1023) != 0) return false;
+        if (stopToken != nullptr && stopToken->stopped()) return true;
+        return timeInMicro != LONG_MAX && duration_cast<microseconds>(steady_clock::now() - start).count() >= timeInMicro;
+    }
+
+    // Multiple iterative deepening: works below the node until phi or delta reaches its threshold.
+    // Returns the node's values, which are also stored unless a solved entry keeps the slot.
+    Entry search(int depth, uint32_t thresholdPhi, uint32_t thresholdDelta, player_t player) {
+        nodes++;
+        if (outOfTime()) {
+            aborted = true;
+            return Entry();
+        }
+        player_t opponent = player == ONE ? TWO : ONE;
+        uint64_t key = pitch->getKey(player);
+        if ((int)frames.size() <= depth) frames.emplace_back();
+        Frame & frame = frames[depth];
+
+        solvable = endgame.prepare(*pitch);
+        int solved = solvable ? endgame.solve(*pitch, player) : ENDGAME_UNKNOWN;
+        if (solved != ENDGAME_UNKNOWN) {
+            if (solved == ENDGAME_WIN) return store(key, 0, DFPN_INFINITY);
+            return store(key, DFPN_INFINITY, 0);
+        }
+        if (generate(frame, player)) return store(key, 0, DFPN_INFINITY);
+        if (overflow && player != attacker) return store(key, 0, DFPN_INFINITY);
+
+        while (true) {
+            uint32_t phi = DFPN_INFINITY, delta = 0, second = DFPN_INFINITY;
+            int best = -1;
+            for (int i=0; i < (int)frame.children.size(); i++) {
+                uint32_t childPhi, childDelta;
+                values(frame.children[i], childPhi, childDelta);
+                delta = sum(delta, childPhi);
+                if (childDelta < phi) {
+                    second = phi;
+                    phi = childDelta;
+                    best = i;
+                } else if (childDelta < second) {
+                    second = childDelta;
+                }
+            }
+            if (phi >= thresholdPhi || delta >= thresholdDelta) return store(key, phi, delta);
+
+            Child & child = frame.children[best];
+            uint32_t childPhi, childDelta;
+            values(child, childPhi, childDelta);
+            uint32_t childThresholdPhi = thresholdDelta == DFPN_INFINITY ? DFPN_INFINITY : sum(thresholdDelta - delta, childPhi);
+            uint32_t childThresholdDelta = min(thresholdPhi, sum(second, 1));
+
+            int ball = pitch->ball;
+            for (int i=0; i < child.length; i++) {
+                int n = frame.path[child.start + i];
+                pitch->addEdge(pitch->ball, n);
+                pitch->ball = n;
+            }
+            Entry result = search(depth + 1, childThresholdPhi, childThresholdDelta, opponent);
+            for (int i=child.length-1; i >= 0; i--) {
+                pitch->removeEdge(i == 0 ? ball : frame.path[child.start + i - 1], frame.path[child.start + i]);
+            }
+            pitch->ball = ball;
+            if (aborted) return result;
+            // kept in the child, the table may have given the slot to a solved entry
+            child.known = true;
+            child.phi = result.phi;
+            child.delta = result.delta;
+        }
+    }
+
+    // children of the position, true as soon as one of them wins; turns that lose on the spot
+    // are left out, a position without children is lost
+    bool generate(Frame & frame, player_t player) {
+        frame.children.clear();
+        frame.path.clear();
+        seen.clear();
+        turn.clear();
+        overflow = false;
+        return walk(frame, pitch->ball, 0, player);
+    }
+
+    bool walk(Frame & frame, int t, int step, player_t player) {
+        if ((int)neighbours.size() <= step) neighbours.emplace_back();
+        vector<int> & ns = neighbours[step];
+        pitch->fillFreeNeighbours(ns, t);
+        player_t opponent = player == ONE ? TWO : ONE;
+
+        for (auto & n : ns) {
+            pitch->addEdge(t, n);
+            pitch->ball = n;
+            turn.push_back(n);
+            bool win = false;
+            if (seen.insert(pitch->getKey(player)).second) {
+                player_t goal = pitch->goal(n);
+                if (goal != NONE) {
+                    if (goal != player) win = addChild(frame, opponent, true, DFPN_INFINITY, 0);
+                } else if (pitch->isBlocked(n)) {
+                    // stuck, lost
+                } else if (pitch->passNextDone(n)) {
+                    win = walk(frame, n, step + 1, player);
+                } else {
+                    int solved = solvable ? endgame.solve(*pitch, opponent) : ENDGAME_UNKNOWN;
+                    if (solved == ENDGAME_LOSS) win = addChild(frame, opponent, true, DFPN_INFINITY, 0);
+                    else if (solved == ENDGAME_UNKNOWN) addChild(frame, opponent, false, 1, 1);
+                }
+            }
+            turn.pop_back();
+            pitch->ball = t;
+            pitch->removeEdge(t, n);
+            if (win || overflow) return win;
+        }
+        return false;
+    }
+
+    // true if the child wins for the player who made the turn
+    bool addChild(Frame & frame, player_t opponent, bool known, uint32_t phi, uint32_t delta) {
+        if ((int)frame.children.size() == DFPN_MOVES) {
+            overflow = true;
+            return false;
+        }
+        frame.children.push_back({pitch->getKey(opponent), (int)frame.path.size(), (int)turn.size(), known, phi, delta});
+        frame.path.insert(frame.path.end(), turn.begin(), turn.end());
+        return known && delta == 0;
+    }
+};
+
+#endif // DFPN_H
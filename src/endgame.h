@@ -0,0 +1,166 @@
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+#include <vector>
+#include <cstdint>
+#include "pitch.h"
+
+using namespace std;
+
+#define ENDGAME_EDGES 64 // largest region, one bit per free edge
+#define ENDGAME_NODES 10000 // steps searched after each prepare, shared by its solves
+#define ENDGAME_TABLE 16384 // memo entries, power of two
+
+#define ENDGAME_UNKNOWN 0
+#define ENDGAME_WIN 1
+#define ENDGAME_LOSS 2
+
+// Exact value of positions whose ball can only reach a few free edges. Those edges (not through
+// goals) are the whole future of the game, so prepare copies them into a compact region, one bit
+// each, and solve searches it step by step with the rules of Game: entering a goal ends the game,
+// entering a touched node continues the turn, ending on a node with no free edge loses.
+// Drawing edges only shrinks the region, so one prepare serves every position after it: move
+// generation prepares once for the parent and solves each child, and the children share the
+// memo, which is keyed by (free edges, ball, player) and kept until the next prepare.
+// The pitch is only read. One instance per thread.
+class EndgameSolver {
+public:
+    EndgameSolver() : table(ENDGAME_TABLE) {
+    }
+
+    // false if the region of the ball is too big, solve then always gives ENDGAME_UNKNOWN
+    bool prepare(Pitch & pitch) {
+        generation++;
+        nodes = 0;
+        ready = extract(pitch);
+        return ready;
+    }
+
+    // ENDGAME_WIN or ENDGAME_LOSS for player to move from the ball of a position reached from the
+    // prepared one, ENDGAME_UNKNOWN without a region or when the steps ran out
+    int solve(Pitch & pitch, player_t player) {
+        if (!ready || local[pitch.ball] == -1) return ENDGAME_UNKNOWN;
+        uint64_t mask = 0;
+        for (int i=0; i < (int)edgeNodes.size(); i += 2) {
+            if (pitch.matrix[edgeNodes[i] * pitch.size + edgeNodes[i+1]] <= 1) mask |= 1ULL << (i/2);
+        }
+        aborted = false;
+        bool win = step(mask, local[pitch.ball], player);
+        if (aborted) return ENDGAME_UNKNOWN;
+        return win ? ENDGAME_WIN : ENDGAME_LOSS;
+    }
+
+private:
+    struct Entry {
+        uint64_t mask;
+        uint32_t generation;
+        uint16_t at;
+        uint8_t player;
+        uint8_t win;
+    };
+
+    struct Link {
+        int edge;
+        int node;
+    };
+
+    // region of the last prepare; links keeps its inner vectors between prepares
+    vector<int> regionNodes;
+    vector<int> local; // pitch node -> region node, -1 outside
+    vector<int> edgeNodes; // pitch nodes of every region edge, two per edge
+    vector<uint64_t> nodeEdges; // region edges at a region node
+    vector<int> degree; // all edges of a region node, drawn or not
+    vector<player_t> goals;
+    vector<vector<Link>> links;
+    bool ready = false;
+
+    vector<Entry> table;
+    uint32_t generation = 0;
+    int nodes = 0;
+    bool aborted = false;
+
+    bool extract(Pitch & pitch) {
+        if ((int)local.size() != pitch.size) local.assign(pitch.size, -1);
+        for (auto &index : regionNodes) local[index] = -1;
+        regionNodes.clear();
+        edgeNodes.clear();
+        nodeEdges.clear();
+        degree.clear();
+        goals.clear();
+        int edges = 0;
+
+        addNode(pitch, pitch.ball);
+        for (int i=0; i < (int)regionNodes.size(); i++) {
+            int q = regionNodes[i];
+            if (pitch.goal(q) != NONE) continue;
+            int t = q * pitch.size;
+            for (auto &v : pitch.matrixNeighbours[q]) {
+                if (pitch.matrix[t + v] > 1) continue;
+                if (local[v] == -1) addNode(pitch, v);
+                else if (local[v] < i) continue; // added from the other end
+                if (edges == ENDGAME_EDGES) return false;
+                int a = i, b = local[v];
+                nodeEdges[a] |= 1ULL << edges;
+                nodeEdges[b] |= 1ULL << edges;
+                links[a].push_back({edges, b});
+                links[b].push_back({edges, a});
+                edgeNodes.push_back(q);
+                edgeNodes.push_back(v);
+                edges++;
+            }
+        }
+        return true;
+    }
+
+    void addNode(Pitch & pitch, int index) {
+        local[index] = regionNodes.size();
+        regionNodes.push_back(index);
+        nodeEdges.push_back(0);
+        degree.push_back(pitch.matrixNodes[index] >> 4);
+        goals.push_back(pitch.goal(index));
+        if (links.size() < regionNodes.size()) links.emplace_back();
+        links[regionNodes.size()-1].clear();
+    }
+
+    // player has to draw the next edge from node at; true if player can force a win
+    bool step(uint64_t mask, int at, player_t player) {
+        if (aborted) return false;
+        if (++nodes > ENDGAME_NODES) {
+            aborted = true;
+            return false;
+        }
+        Entry & entry = table[hash(mask, at, player) & (ENDGAME_TABLE-1)];
+        if (entry.generation == generation && entry.mask == mask && entry.at == at && entry.player == player) return entry.win;
+
+        player_t opponent = player == ONE ? TWO : ONE;
+        bool win = false;
+        for (auto &link : links[at]) {
+            if ((mask & (1ULL << link.edge)) == 0) continue;
+            uint64_t next = mask & ~(1ULL << link.edge);
+            int n = link.node;
+            if (goals[n] != NONE) {
+                win = goals[n] != player;
+            } else {
+                int free = __builtin_popcountll(next & nodeEdges[n]);
+                if (free == 0) continue; // stuck there
+                bool touched = free + 1 < degree[n];
+                win = touched ? step(next, n, player) : !step(next, n, opponent);
+            }
+            if (win || aborted) break;
+        }
+        if (aborted) return false;
+
+        entry = {mask, generation, (uint16_t)at, (uint8_t)player, (uint8_t)win}; // deeper steps may have replaced it, still the right slot
+        return win;
+    }
+
+    static uint64_t hash(uint64_t mask, int at, player_t player) {
+        uint64_t x = mask ^ (uint64_t)(at * 4 + player) * 0x9E3779B97F4A7C15ULL;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return x;
+    }
+};
+
+#endif // ENDGAME_H
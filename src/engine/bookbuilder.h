@@ -0,0 +1,107 @@
+#ifndef BOOKBUILDER_H
+#define BOOKBUILDER_H
+
+#include <iostream>
+#include <unordered_set>
+#include <deque>
+#include "cpumctstt.h"
+#include "openingbook.h"
+#include "options.h"
+
+using namespace std;
+
+// Builds an opening book: every position of the first --plies turns (both players starting)
+// gets a long search on all --threads. Its best move and the most visited others, --width in all,
+// are stored and the positions after them searched in turn. Positions are searched once however they are reached.
+class BookBuilder {
+public:
+    explicit BookBuilder(Options & options) : cpu(options.getInt("poolSize", 1<<24)) {
+        cpu.agent = loadInferenceNetwork(options);
+        cpu.moveLimit = options.getInt("moveLimit", 750);
+        cpu.alpha = options.getFloat("alpha", cpu.alpha);
+        cpu.FPU = options.getFloat("FPU", cpu.FPU);
+        cpu.C = options.getFloat("C", cpu.C);
+        cpu.Croot = options.getFloat("Croot", cpu.Croot);
+        plies = options.getInt("plies", 4);
+        width = options.getInt("width", 3);
+        timeInMicro = 1000L * options.getLong("time", 10000);
+        threads = options.getInt("threads", thread::hardware_concurrency());
+        if (threads < 1) threads = 1;
+        outputFile = options.getString("output", "book");
+    }
+
+    virtual ~BookBuilder() {
+        delete cpu.agent;
+    }
+
+    int run() {
+        deque<pair<Game,int>> positions;
+        unordered_set<uint64_t> seen;
+        for (auto first : {ONE, TWO}) {
+            Game game;
+            game.currentPlayer = first;
+            positions.push_back({game, 0});
+        }
+
+        vector<BookEntry> entries;
+        int searched = 0;
+        while (!positions.empty()) {
+            Game game = positions.front().first;
+            int ply = positions.front().second;
+            positions.pop_front();
+            player_t player = game.currentPlayer;
+            if (!seen.insert(game.pitch.getKey(player)).second) continue;
+            if (game.isOver() || game.pitch.isNextMoveGameover(player) || game.pitch.isNextMoveGameover(player == ONE ? TWO : ONE)) continue;
+
+            cpu.setGame(&game);
+            cpu.setPlayer(player);
+            cpu.stopToken->reset();
+            cpu.getBestMove(timeInMicro, threads);
+            searched++;
+
+            // the search's choice first, then the most visited others
+            vector<MoveMctsTTR2*> others = cpu.rootMoves;
+            sort(others.begin(), others.end(), [](const MoveMctsTTR2 *a, const MoveMctsTTR2 *b) { return a->games > b->games; });
+            vector<MoveMctsTTR2*> moves = {cpu.rootMoves[0]};
+            for (auto & m : others) {
+                if ((int)moves.size() < width && m != cpu.rootMoves[0]) moves.push_back(m);
+            }
+
+            for (auto & m : moves) {
+                if ((int)m->move.size() >= BOOK_MOVE) continue;
+                BookEntry entry;
+                memset(&entry, 0, sizeof(entry));
+                entry.key = game.pitch.getKey(player);
+                entry.visits = m->games;
+                entry.winRate = cpu.getWinRate(m);
+                memcpy(entry.move, m->move.data(), m->move.size());
+                entries.push_back(entry);
+
+                if (ply+1 < plies) {
+                    Game next = game;
+                    for (auto & c : m->move) next.makeMove(string(1,c));
+                    positions.push_back({next, ply+1});
+                }
+            }
+            cout << "ply " << ply << " position " << searched << " best " << cpu.rootMoves[0]->move << " "
+                 << cpu.getWinRate(cpu.rootMoves[0]) << "% queued " << positions.size() << endl;
+        }
+
+        if (!OpeningBook::save(outputFile, entries)) {
+            cerr << "cannot write " << outputFile << endl;
+            return 1;
+        }
+        cout << "saved " << entries.size() << " moves of " << searched << " positions to " << outputFile << endl;
+        return 0;
+    }
+
+private:
+    CpuMctsTTRParallel cpu;
+    int plies;
+    int width;
+    long timeInMicro;
+    int threads;
+    string outputFile;
+};
+
+#endif // BOOKBUILDER_H
@@ -0,0 +1,52 @@
+# Headless engine without Qt, built from the same headers as the gui:
+#   cd src/engine && qmake . && make
+
+TEMPLATE = app
+TARGET = PaperSoccerEngine
+
+CONFIG += console c++17 thread
+CONFIG -= app_bundle qt
+
+# the evaluation loops rely on auto-vectorization, which gcc and clang only do fully at -O3
+!msvc {
+    QMAKE_CXXFLAGS_RELEASE -= -O2
+    QMAKE_CXXFLAGS_RELEASE += -O3
+}
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp
+
+HEADERS += \
+    ../cpu.h \
+    ../cpumctstt.h \
+    ../dfpn.h \
+    ../endgame.h \
+    ../evalcache.h \
+    ../game.h \
+    ../gamedatabase.h \
+    ../inference.h \
+    ../mappedfile.h \
+    ../mctscpu.h \
+    ../negamaxcpu.h \
+    ../network.h \
+    ../openingbook.h \
+    ../pitch.h \
+    ../random.h \
+    ../rl.h \
+    ../sample.h \
+    ../samplefile.h \
+    ../snapshot.h \
+    ../stoptoken.h \
+    ../timemanager.h \
+    ../trainer.h \
+    ../utils.h \
+    bookbuilder.h \
+    gamestool.h \
+    match.h \
+    mctsbench.h \
+    options.h \
+    protocol.h \
+    server.h \
+    tuner.h
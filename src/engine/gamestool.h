@@ -0,0 +1,83 @@
+#ifndef GAMESTOOL_H
+#define GAMESTOOL_H
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include "gamedatabase.h"
+#include "options.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// PaperSoccerEngine games:
+//   --import <file> --output <db>   one notation per line, first player from --first (2 by default)
+//   --db <db> --position <notation> games reaching the position and their results, --list of them shown
+//   --db <db> --samples <file>      training samples of the finished games
+// --threads for the import and the samples, all cores by default.
+class GamesTool {
+public:
+    explicit GamesTool(Options & options) : options(options) {
+        threads = options.getInt("threads", thread::hardware_concurrency());
+        if (threads < 1) threads = 1;
+    }
+
+    int run() {
+        if (options.has("import")) return import();
+        GameDatabase database;
+        if (!database.open(options.getString("db", "games.db"))) return 1;
+        if (options.has("position")) return query(database);
+        if (options.has("samples")) return samples(database);
+        cout << database.games() << " games, " << database.positionCount() << " positions" << endl;
+        return 0;
+    }
+
+private:
+    Options & options;
+    int threads;
+
+    int import() {
+        auto start = steady_clock::now();
+        player_t first = options.getInt("first", 2) == 1 ? ONE : TWO;
+        vector<GameSource> sources;
+        ifstream in(options.getString("import", "games.txt"));
+        string line;
+        while (getline(in, line)) {
+            if (!line.empty()) sources.push_back({line, first});
+        }
+        string output = options.getString("output", "games.db");
+        int skipped;
+        if (!GameDatabase::build(sources, output, threads, skipped)) {
+            cerr << "cannot write " << output << endl;
+            return 1;
+        }
+        long ms = duration_cast<milliseconds>(steady_clock::now() - start).count();
+        cout << "saved " << sources.size() - skipped << " games to " << output << " in " << ms << " ms, skipped "
+             << skipped << " with illegal steps" << endl;
+        return 0;
+    }
+
+    int query(GameDatabase & database) {
+        Game game;
+        game.loadNotation(options.getString("position", ""), options.getInt("first", 2) == 1 ? ONE : TWO);
+        auto stats = database.stats(game);
+        cout << "games " << stats.games << " wins " << stats.wins << " losses " << stats.losses
+             << " unfinished " << stats.unfinished << " (player to move " << game.currentPlayer << ")" << endl;
+        int list = options.getInt("list", 10);
+        for (auto & index : database.gamesReaching(game)) {
+            if (list-- <= 0) break;
+            cout << index << ": " << database.notation(index) << endl;
+        }
+        return 0;
+    }
+
+    int samples(GameDatabase & database) {
+        string output = options.getString("samples", "samples");
+        SampleWriter writer(output);
+        long count = database.extractSamples(writer, threads);
+        cout << "wrote " << count << " samples to " << output << endl;
+        return 0;
+    }
+};
+
+#endif // GAMESTOOL_H
@@ -0,0 +1,97 @@
+#include "options.h"
+#include "protocol.h"
+#include "match.h"
+#include "tuner.h"
+#include "bookbuilder.h"
+#include "gamestool.h"
+#include "mctsbench.h"
+#include "server.h"
+#include "rl.h"
+#include "trainer.h"
+
+int main(int argc, char *argv[]) {
+    srand(time(NULL) ^ uint64_t(&main));
+    Pitch(8,10).GENERATE_ALL_EDGES();
+
+    Options options(argc, argv);
+    if (options.mode.empty() || options.mode == "engine") {
+        EngineProtocol protocol(options);
+        protocol.run(cin);
+        return 0;
+    }
+    if (options.mode == "server") {
+        EngineServer server(options);
+        server.run(cin);
+        return 0;
+    }
+    if (options.mode == "match") {
+        MatchRunner runner(options);
+        return runner.run();
+    }
+    if (options.mode == "tune") {
+        Tuner tuner(options);
+        return tuner.run();
+    }
+    if (options.mode == "book") {
+        BookBuilder builder(options);
+        return builder.run();
+    }
+    if (options.mode == "games") {
+        GamesTool tool(options);
+        return tool.run();
+    }
+    if (options.mode == "mctsbench") {
+        MctsBench bench(options);
+        return bench.run();
+    }
+    if (options.mode == "selfplay") {
+        SelfPlay selfPlay(loadInferenceNetwork(options));
+        selfPlay.concurrency = options.getInt("concurrency", thread::hardware_concurrency());
+        selfPlay.games = options.getInt("games", 100);
+        selfPlay.expansions = options.getInt("expansions", 200);
+        selfPlay.temperature = options.getFloat("temperature", 3.0f);
+        selfPlay.temperatureRounds = options.getInt("temperatureRounds", 20);
+        selfPlay.openingSteps = options.getInt("openingSteps", 2);
+        selfPlay.poolSize = options.getInt("poolSize", 1<<20);
+        selfPlay.outputFile = options.getString("output", "samples");
+        ReplayMemory *replay = nullptr;
+        if (options.has("replay")) {
+            replay = new ReplayMemory(options.getLong("replaySize", 1<<22), options.getString("replay", "replay"));
+            selfPlay.replay = replay;
+        }
+        selfPlay.run();
+        delete replay;
+        delete selfPlay.network;
+        return 0;
+    }
+    if (options.mode == "convert") {
+        Network *network = loadNetwork(options);
+        int quantization = options.getString("quantize", "float") == "int16" ? QUANT_INT16 : QUANT_FLOAT;
+        bool saved = network->saveWeights(options.getString("output", "converted_net"), quantization);
+        delete network;
+        return saved ? 0 : 1;
+    }
+    if (options.mode == "train") {
+        Network *network;
+        if (options.has("fresh")) {
+            network = new NetworkDeep(1466,options.getInt("hidden", 96),options.getInt("hidden2", 32));
+            network->type = 2;
+        } else {
+            network = loadNetwork(options);
+        }
+        network->alpha = options.getFloat("rate", 0.001f);
+        network->mom = options.getFloat("momentum", 0.8f);
+        Trainer trainer(network);
+        trainer.threads = options.getInt("threads", thread::hardware_concurrency());
+        trainer.batchSize = options.getInt("batch", 1024);
+        trainer.lambda = options.getFloat("lambda", 0.5f);
+        trainer.epochs = options.getInt("epochs", 1);
+        trainer.decoders = options.getInt("decoders", 2);
+        trainer.train(options.getString("samples", "samples"), options.getString("output", "trained"));
+        delete network;
+        return 0;
+    }
+
+    cerr << "unknown mode " << options.mode << endl;
+    return 1;
+}
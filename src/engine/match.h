@@ -0,0 +1,289 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cmath>
+#include "cpumctstt.h"
+#include "negamaxcpu.h"
+#include "options.h"
+
+using namespace std;
+
+// search settings of one side, --key for engine A (base), --keyB for engine B (tested).
+// --engine negamax plays the Lazy SMP negamax instead of MCTS, --threads is per move for both.
+class MatchEngine {
+public:
+    bool negamax = false;
+    int threads = 1;
+    float alpha = 0.35f;
+    float FPU = 0.5f;
+    float C = 0.95f;
+    float Croot = 1.0f;
+    int moveLimit = 750;
+    long timeInMicro = 100000L;
+    int visits = 0;
+
+    MatchEngine() { }
+
+    explicit MatchEngine(Options & options, const string & suffix) {
+        negamax = options.getString("engine"+suffix, options.getString("engine", "mcts")) == "negamax";
+        threads = max(1, options.getInt("threads"+suffix, options.getInt("threads", 1)));
+        alpha = options.getFloat("alpha"+suffix, options.getFloat("alpha", 0.35f));
+        FPU = options.getFloat("FPU"+suffix, options.getFloat("FPU", 0.5f));
+        C = options.getFloat("C"+suffix, options.getFloat("C", 0.95f));
+        Croot = options.getFloat("Croot"+suffix, options.getFloat("Croot", 1.0f));
+        moveLimit = options.getInt("moveLimit"+suffix, options.getInt("moveLimit", 750));
+        timeInMicro = 1000L * options.getLong("time"+suffix, options.getLong("time", 100));
+        visits = options.getInt("visits"+suffix, options.getInt("visits", 0));
+    }
+
+    void apply(CpuMctsTTRParallel & cpu) {
+        cpu.alpha = alpha;
+        cpu.FPU = FPU;
+        cpu.C = C;
+        cpu.Croot = Croot;
+        cpu.moveLimit = moveLimit;
+        cpu.visitLimit = visits;
+    }
+
+    // MCTS node pool lasting the whole move time: 512 nodes per ms and thread, about three
+    // times what a search takes, as a power of two
+    int poolSize() {
+        long nodes = timeInMicro / 1000 * 512 * threads;
+        int size = 1 << 16;
+        while (size < nodes && size < (1 << 26)) size *= 2;
+        return size;
+    }
+};
+
+// the searcher of one side in a match thread, made for the engine it plays; poolSize 0 is the
+// engine's own
+class MatchPlayer {
+public:
+    explicit MatchPlayer(MatchEngine & engine, INetwork *network, int poolSize, StopToken *stopToken = nullptr) {
+        if (engine.negamax) {
+            evaluator = new NetworkEvaluator(network);
+            negamax = new NegamaxCpu(evaluator);
+            negamax->setThreads(engine.threads);
+            if (stopToken != nullptr) negamax->stopToken = stopToken;
+        } else {
+            mcts = new CpuMctsTTRParallel(poolSize > 0 ? poolSize : engine.poolSize());
+            mcts->agent = network;
+            if (stopToken != nullptr) mcts->stopToken = stopToken;
+        }
+    }
+
+    virtual ~MatchPlayer() {
+        delete mcts;
+        delete negamax;
+        delete evaluator;
+    }
+
+    MatchPlayer(const MatchPlayer &) = delete;
+    MatchPlayer & operator=(const MatchPlayer &) = delete;
+
+    string bestMove(MatchEngine & engine, Game & game) {
+        if (negamax != nullptr) {
+            negamax->setGame(&game);
+            negamax->setPlayer(game.currentPlayer);
+            return negamax->getBestMove(engine.timeInMicro).move;
+        }
+        engine.apply(*mcts);
+        mcts->setGame(&game);
+        mcts->setPlayer(game.currentPlayer);
+        return mcts->getBestMove(engine.timeInMicro, engine.threads)->move;
+    }
+
+    bool stopped() {
+        return negamax != nullptr ? negamax->stopToken->stopped() : mcts->stopToken->stopped();
+    }
+
+private:
+    CpuMctsTTRParallel *mcts = nullptr;
+    NegamaxCpu *negamax = nullptr;
+    NetworkEvaluator *evaluator = nullptr;
+};
+
+// random single steps from the start, the position must still be open
+string randomOpening(Random & random, int openingSteps) {
+    while (true) {
+        Game game;
+        string opening;
+        for (int i=0; i < openingSteps && !game.isOver(); i++) {
+            auto actions = game.getLegalActions();
+            char step = '0' + actions[random.nextInt(actions.size())];
+            game.makeMove(string(1,step));
+            opening += step;
+        }
+        if (!game.isOver() && !game.pitch.isNextMoveGameover(game.currentPlayer)
+                && !game.pitch.isNextMoveGameover(game.currentPlayer == ONE ? TWO : ONE)) {
+            return opening;
+        }
+    }
+}
+
+// plays one game from the opening, 1 if engine B wins, -1 if it loses, unfinished if stopped
+int playMatchGame(MatchPlayer & cpuA, MatchEngine & engineA, MatchPlayer & cpuB, MatchEngine & engineB,
+                  const string & opening, player_t playerB) {
+    Game game;
+    for (auto & c : opening) game.makeMove(string(1,c));
+
+    while (!game.isOver() && !cpuB.stopped()) {
+        player_t player = game.currentPlayer;
+        if (game.pitch.isNextMoveGameover(player == ONE ? TWO : ONE)) {
+            game.makeMove(game.pitch.shortWinningMoveForPlayer(player));
+            continue;
+        }
+        bool turnB = player == playerB;
+        auto & cpu = turnB ? cpuB : cpuA;
+        auto & engine = turnB ? engineB : engineA;
+        game.makeMove(cpu.bestMove(engine, game));
+    }
+
+    int winner = game.getWinner();
+    if (winner == playerB) return 1;
+    if (winner != NONE) return -1;
+    return 0;
+}
+
+// Plays engine B against engine A, every thread runs its own pair of engines.
+// Each random opening is played twice with colours swapped. Stops after --games games or
+// when SPRT(elo0,elo1) accepts a hypothesis. Results are from engine B's point of view.
+class MatchRunner {
+public:
+    explicit MatchRunner(Options & options) : options(options), engineA(options, ""), engineB(options, "B") {
+        concurrency = options.getInt("concurrency", thread::hardware_concurrency());
+        if (concurrency < 1) concurrency = 1;
+        maxGames = options.getInt("games", 1000);
+        openingSteps = options.getInt("openingSteps", 2);
+        poolSize = options.getInt("poolSize", 0);
+        elo0 = options.getFloat("elo0", 0);
+        elo1 = options.getFloat("elo1", 5);
+        sprtAlpha = options.getFloat("sprtAlpha", 0.05f);
+        sprtBeta = options.getFloat("sprtBeta", 0.05f);
+
+        networkA = loadInferenceNetwork(options);
+        networkB = options.has("netfileB") ? loadInferenceNetwork(options, "B") : networkA;
+    }
+
+    virtual ~MatchRunner() {
+        if (networkB != networkA) delete networkB;
+        delete networkA;
+    }
+
+    // returns 0 when H1 (B is stronger by elo1) is accepted, 1 otherwise
+    int run() {
+        cout << "games " << maxGames << " concurrency " << concurrency << " sprt [" << elo0 << ", " << elo1 << "]" << endl;
+        vector<thread> threads;
+        for (int i=0; i < concurrency; i++) {
+            threads.push_back(thread(&MatchRunner::play, this, i));
+        }
+        for (auto & t : threads) t.join();
+
+        report();
+        if (llr() >= upperBound()) {
+            cout << "H1 accepted" << endl;
+            return 0;
+        }
+        if (llr() <= lowerBound()) cout << "H0 accepted" << endl;
+        else cout << "inconclusive" << endl;
+        return 1;
+    }
+
+private:
+    Options & options;
+    MatchEngine engineA, engineB;
+    INetwork *networkA, *networkB;
+
+    int concurrency;
+    int maxGames;
+    int openingSteps;
+    int poolSize;
+    float elo0, elo1;
+    float sprtAlpha, sprtBeta;
+
+    atomic<int> nextPair{0};
+    atomic<bool> finished{false};
+    StopToken stopToken; // shared by all engines, ends the games still running once decided
+    mutex resultsLock;
+    int wins = 0, draws = 0, losses = 0;
+
+    void play(int th) {
+        MatchPlayer cpuA(engineA, networkA, poolSize, &stopToken), cpuB(engineB, networkB, poolSize, &stopToken);
+        Random random(Random().nextLong() ^ (th+1));
+
+        while (!finished && 2*nextPair.fetch_add(1) < maxGames) {
+            string opening = randomOpening(random, openingSteps);
+            int first = playMatchGame(cpuA, engineA, cpuB, engineB, opening, ONE);
+            int second = playMatchGame(cpuA, engineA, cpuB, engineB, opening, TWO);
+            if (stopToken.stopped()) break;
+
+            lock_guard<mutex> guard(resultsLock);
+            for (int result : { first, second }) {
+                if (result > 0) wins++;
+                else if (result < 0) losses++;
+                else draws++;
+            }
+            report();
+            if (wins+draws+losses >= maxGames || llr() >= upperBound() || llr() <= lowerBound()) {
+                finished = true;
+                stopToken.stop();
+            }
+        }
+    }
+
+    static double expectedScore(double elo) {
+        return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+    }
+
+    double score() {
+        int n = wins+draws+losses;
+        return n == 0 ? 0.5 : (wins + 0.5*draws) / n;
+    }
+
+    double variance() {
+        int n = wins+draws+losses;
+        if (n == 0) return 0;
+        double s = score();
+        return (wins*(1-s)*(1-s) + draws*(0.5-s)*(0.5-s) + losses*s*s) / n;
+    }
+
+    // normal approximation of the log-likelihood ratio
+    double llr() {
+        double var = variance();
+        if (var <= 0) return 0;
+        double s0 = expectedScore(elo0), s1 = expectedScore(elo1);
+        return (wins+draws+losses) * (s1-s0) * (2*score() - s0 - s1) / (2*var);
+    }
+
+    double lowerBound() {
+        return log(sprtBeta / (1-sprtAlpha));
+    }
+
+    double upperBound() {
+        return log((1-sprtBeta) / sprtAlpha);
+    }
+
+    static double elo(double s) {
+        s = min(max(s, 1e-6), 1-1e-6);
+        return -400.0 * log10(1.0/s - 1.0);
+    }
+
+    void report() {
+        int n = wins+draws+losses;
+        double s = score();
+        double margin = n == 0 ? 0 : 1.96 * sqrt(variance() / n);
+        double e = elo(s);
+        double error = (elo(s+margin) - elo(s-margin)) / 2;
+        cout << fixed << setprecision(2)
+             << "games " << n << " W " << wins << " D " << draws << " L " << losses
+             << " elo " << e << " +- " << error
+             << " llr " << llr() << " (" << lowerBound() << ", " << upperBound() << ")" << endl;
+    }
+};
+
+#endif // MATCH_H
@@ -0,0 +1,59 @@
+#ifndef MCTSBENCH_H
+#define MCTSBENCH_H
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include "mctscpu.h"
+#include "options.h"
+
+using namespace std;
+
+// PaperSoccerEngine mctsbench: playouts per second of MctsCpu with a shared tree and root
+// parallel, for each of --threads (a list like 1,2,4,8) searching --time ms from --position
+// (a notation, first player from --first, 2 by default). Speedups are against the first thread
+// count of the same mode.
+class MctsBench {
+public:
+    explicit MctsBench(Options & options) : options(options) {
+    }
+
+    int run() {
+        vector<int> threadCounts;
+        stringstream list(options.getString("threads", "1,2,4,8"));
+        string item;
+        while (getline(list, item, ',')) {
+            if (atoi(item.c_str()) > 0) threadCounts.push_back(atoi(item.c_str()));
+        }
+        long timeInMicro = 1000L * options.getLong("time", 2000);
+        Game game;
+        game.loadNotation(options.getString("position", ""), options.getInt("first", 2) == 1 ? ONE : TWO);
+
+        cout << "threads  mode           playouts/s  speedup  best" << endl;
+        for (bool rootParallel : {false, true}) {
+            double base = 0;
+            for (auto th : threadCounts) {
+                MctsCpu cpu;
+                cpu.setGame(&game);
+                cpu.setPlayer(game.currentPlayer);
+                cpu.setNumThreads(th);
+                cpu.setRootParallel(rootParallel);
+                auto start = steady_clock::now();
+                MctsMove *best = cpu.getBestMove(timeInMicro);
+                double seconds = duration_cast<microseconds>(steady_clock::now() - start).count() / 1e6;
+                double rate = cpu.games / seconds;
+                if (base == 0) base = rate;
+                cout << setw(7) << th << "  " << setw(13) << left << (rootParallel ? "root parallel" : "shared") << right
+                     << setw(12) << (long)rate << setw(9) << fixed << setprecision(2) << rate / base
+                     << "  " << best->move << endl;
+                cout.unsetf(ios::fixed);
+            }
+        }
+        return 0;
+    }
+
+private:
+    Options & options;
+};
+
+#endif // MCTSBENCH_H
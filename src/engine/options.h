@@ -0,0 +1,78 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <map>
+#include <string>
+#include <cstdlib>
+#include "network.h"
+#include "inference.h"
+
+using namespace std;
+
+// command line in form: PaperSoccerEngine [mode] --key value --key2 value2 ...
+class Options {
+public:
+    string mode;
+    map<string,string> values;
+
+    explicit Options(int argc, char *argv[]) {
+        int i = 1;
+        if (argc > 1 && argv[1][0] != '-') {
+            mode = argv[1];
+            i = 2;
+        }
+        for (; i < argc; i++) {
+            string key = argv[i];
+            if (key.size() < 3 || key[0] != '-' || key[1] != '-') continue;
+            key = key.substr(2);
+            if (i+1 < argc && (argv[i+1][0] != '-' || argv[i+1][1] != '-')) {
+                values[key] = argv[i+1];
+                i++;
+            } else {
+                values[key] = "true";
+            }
+        }
+    }
+
+    bool has(const string & key) {
+        return values.count(key) > 0;
+    }
+
+    string getString(const string & key, const string & def) {
+        return has(key) ? values[key] : def;
+    }
+
+    int getInt(const string & key, int def) {
+        return has(key) ? atoi(values[key].c_str()) : def;
+    }
+
+    long getLong(const string & key, long def) {
+        return has(key) ? atol(values[key].c_str()) : def;
+    }
+
+    float getFloat(const string & key, float def) {
+        return has(key) ? (float)atof(values[key].c_str()) : def;
+    }
+};
+
+// same defaults as qtpapersoccer.ini, exits if the file is unusable. Suffix selects e.g. --netfileB (falls back to --netfile)
+Network* loadNetwork(Options & options, const string & suffix = "") {
+    int hidden = options.getInt("hidden"+suffix, options.getInt("hidden", 96));
+    int hidden2 = options.getInt("hidden2"+suffix, options.getInt("hidden2", 32));
+    Network* network = createNetwork(options.getString("netfile"+suffix, options.getString("netfile", "96_32_net")),hidden,hidden2);
+    if (network == nullptr) exit(1);
+    return network;
+}
+
+// same for playing, without the training buffers
+INetwork* loadInferenceNetwork(Options & options, const string & suffix = "") {
+    int hidden = options.getInt("hidden"+suffix, options.getInt("hidden", 96));
+    int hidden2 = options.getInt("hidden2"+suffix, options.getInt("hidden2", 32));
+    INetwork* network = InferenceNetwork::load(options.getString("netfile"+suffix, options.getString("netfile", "96_32_net")),hidden,hidden2);
+    if (network == nullptr) exit(1);
+    int cacheSize = options.getInt("evalCache", 16); // MB, 0 disables
+    if (cacheSize > 0) network->cache = new EvalCache(cacheSize);
+    return network;
+}
+
+#endif // OPTIONS_H
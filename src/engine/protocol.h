@@ -0,0 +1,310 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <climits>
+#include "cpumctstt.h"
+#include "openingbook.h"
+#include "options.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// rest of a position command: [startpos] [first 1|2] [moves|notation <notation>]
+void readPosition(stringstream & tokens, Game & game) {
+    string token, notation;
+    player_t first = TWO;
+    while (tokens >> token) {
+        if (token == "first") {
+            tokens >> token;
+            first = token == "1" ? ONE : TWO;
+        } else if (token == "moves" || token == "notation") {
+            // notation may contain spaces before the result letter, take the rest of the line
+            string rest;
+            getline(tokens, rest);
+            stringstream restTokens(rest);
+            while (restTokens >> token) {
+                if (token == "first") {
+                    restTokens >> token;
+                    first = token == "1" ? ONE : TWO;
+                } else {
+                    notation += token;
+                }
+            }
+        }
+    }
+    game = Game();
+    game.loadNotation(notation, first);
+}
+
+// Text protocol on stdin/stdout, one command per line:
+//   isready                                    -> readyok
+//   setoption name <threads|multipv|moveLimit|alpha|FPU|C|Croot|solver> value <v>
+//                                              (stops a running search first)
+//   position [startpos] [first 1|2] [moves <notation>]
+//   position notation <notation> [first 1|2]   (first player defaults to 2, like the gui)
+//   go [time <ms>] [clock <ms> [inc <ms>] [movestogo <n>]] [visits <n>] [threads <n>] [multipv <n>] [infinite|ponder]
+//                                              (time is per move, clock is the time left for the game)
+//   solve [time <ms>] [nodes <n>] [infinite]   -> looks only for a forced win (df-pn), then
+//                                                 "solution win <move>", "solution none" or
+//                                                 "solution unknown" when the limits were hit
+//   stop                                       -> stops the search, bestmove is printed
+//   quit
+// Every infoInterval ms while searching and once at the end: "info time .. visits .. nodes .. nps
+// .. depth .. [evalhits <percent>]" and "info multipv <i> move .. winrate .. visits .. pv .." lines
+// (at most 8), taken from the search snapshots without stopping it. Then "bestmove <move>".
+// With --book a position found in the book gets "info string book .." and its move at once
+// (not for infinite and ponder).
+class EngineProtocol {
+public:
+    explicit EngineProtocol(Options & options) : options(options), cpu(options.getInt("poolSize", 1<<24)) {
+        cpu.agent = loadInferenceNetwork(options);
+        cpu.moveLimit = options.getInt("moveLimit", 750);
+        cpu.alpha = options.getFloat("alpha", cpu.alpha);
+        cpu.FPU = options.getFloat("FPU", cpu.FPU);
+        cpu.C = options.getFloat("C", cpu.C);
+        cpu.Croot = options.getFloat("Croot", cpu.Croot);
+        threads = options.getInt("threads", 4);
+        multiPv = options.getInt("multipv", 1);
+        moveTime = options.getLong("time", 1000);
+        infoInterval = options.getInt("infoInterval", 500);
+        cpu.solverThread = options.getInt("solver", 0) != 0;
+        if (options.has("book")) book.open(options.getString("book", "book"));
+    }
+
+    virtual ~EngineProtocol() {
+        stopSearch();
+        delete cpu.agent;
+    }
+
+    void run(istream & in) {
+        string line;
+        while (getline(in, line)) {
+            stringstream tokens(line);
+            string command;
+            tokens >> command;
+            if (command == "quit") {
+                break;
+            } else if (command == "isready") {
+                send("readyok");
+            } else if (command == "setoption") {
+                stopSearch();
+                setOption(tokens);
+            } else if (command == "position") {
+                stopSearch();
+                setPosition(tokens);
+            } else if (command == "go") {
+                stopSearch();
+                go(tokens);
+            } else if (command == "solve") {
+                stopSearch();
+                solve(tokens);
+            } else if (command == "stop") {
+                stopSearch();
+            } else if (!command.empty()) {
+                send("info string unknown command " + command);
+            }
+        }
+        stopSearch();
+    }
+
+private:
+    Options & options;
+    CpuMctsTTRParallel cpu;
+    OpeningBook book;
+    Game game;
+    Game searchGame;
+    thread searchThread;
+    mutex outputLock;
+
+    int threads;
+    int multiPv;
+    long moveTime;
+    int infoInterval;
+
+    void send(const string & message) {
+        lock_guard<mutex> guard(outputLock);
+        cout << message << endl;
+    }
+
+    void setOption(stringstream & tokens) {
+        string token, name, value;
+        while (tokens >> token) {
+            if (token == "name") tokens >> name;
+            else if (token == "value") tokens >> value;
+        }
+        if (name == "threads") threads = atoi(value.c_str());
+        else if (name == "multipv") multiPv = atoi(value.c_str());
+        else if (name == "moveLimit") cpu.moveLimit = atoi(value.c_str());
+        else if (name == "alpha") cpu.alpha = atof(value.c_str());
+        else if (name == "FPU") cpu.FPU = atof(value.c_str());
+        else if (name == "C") cpu.C = atof(value.c_str());
+        else if (name == "Croot") cpu.Croot = atof(value.c_str());
+        else if (name == "solver") cpu.solverThread = atoi(value.c_str()) != 0;
+        else send("info string unknown option " + name);
+    }
+
+    void setPosition(stringstream & tokens) {
+        readPosition(tokens, game);
+    }
+
+    void go(stringstream & tokens) {
+        string token;
+        long timeInMicro = moveTime * 1000L;
+        long clock = -1, increment = 0;
+        int movesToGo = 30;
+        int th = threads;
+        int pv = multiPv;
+        int visits = 0;
+        bool useBook = true;
+        while (tokens >> token) {
+            if (token == "time") {
+                long ms; tokens >> ms;
+                timeInMicro = ms * 1000L;
+            } else if (token == "clock") {
+                long ms; tokens >> ms;
+                clock = ms * 1000L;
+            } else if (token == "inc") {
+                long ms; tokens >> ms;
+                increment = ms * 1000L;
+            } else if (token == "movestogo") {
+                tokens >> movesToGo;
+            } else if (token == "visits") {
+                tokens >> visits;
+            } else if (token == "threads") {
+                tokens >> th;
+            } else if (token == "multipv") {
+                tokens >> pv;
+            } else if (token == "infinite" || token == "ponder") {
+                timeInMicro = LONG_MAX;
+                clock = -1;
+                useBook = false;
+            }
+        }
+        if (th < 1) th = 1;
+        if (th > 8) th = 8;
+        if (pv < 1) pv = 1;
+
+        if (game.isOver()) {
+            send("info string game over");
+            send("bestmove none");
+            return;
+        }
+        const BookEntry *entry = useBook ? book.lookup(game) : nullptr;
+        if (entry != nullptr) {
+            stringstream ss;
+            ss << "info string book winrate " << entry->winRate << " visits " << entry->visits;
+            send(ss.str());
+            send("bestmove " + string(entry->move));
+            return;
+        }
+        player_t player = game.currentPlayer;
+        if (game.pitch.isNextMoveGameover(player == ONE ? TWO : ONE)) {
+            send("info string short winning move");
+            send("bestmove " + game.pitch.shortWinningMoveForPlayer(player));
+            return;
+        }
+
+        searchGame = game;
+        cpu.setGame(&searchGame);
+        cpu.setPlayer(player);
+        cpu.visitLimit = visits;
+        cpu.stopToken->reset();
+        cpu.snapshotInterval = infoInterval;
+        cpu.snapshotLines = pv;
+        searchThread = thread(&EngineProtocol::search, this, timeInMicro, clock, increment, movesToGo, th);
+    }
+
+    void search(long timeInMicro, long clock, long increment, int movesToGo, int th) {
+        mutex doneLock;
+        condition_variable doneCondition;
+        bool done = false;
+        MoveMctsTTR2 *best = nullptr;
+
+        thread worker([&]() {
+            best = clock >= 0 ? cpu.getBestMoveClock(clock, increment, movesToGo, th) : cpu.getBestMove(timeInMicro, th);
+            lock_guard<mutex> guard(doneLock);
+            done = true;
+            doneCondition.notify_one();
+        });
+
+        {
+            unique_lock<mutex> guard(doneLock);
+            while (!doneCondition.wait_for(guard, milliseconds(infoInterval), [&]() { return done; })) {
+                sendInfo();
+            }
+        }
+        worker.join();
+
+        sendInfo();
+        send("bestmove " + best->move);
+    }
+
+    void solve(stringstream & tokens) {
+        string token;
+        long timeInMicro = moveTime * 1000L;
+        long nodes = 0;
+        while (tokens >> token) {
+            if (token == "time") {
+                long ms; tokens >> ms;
+                timeInMicro = ms * 1000L;
+            } else if (token == "nodes") {
+                tokens >> nodes;
+            } else if (token == "infinite") {
+                timeInMicro = LONG_MAX;
+            }
+        }
+        if (game.isOver()) {
+            send("info string game over");
+            send("solution none");
+            return;
+        }
+
+        searchGame = game;
+        cpu.stopToken->reset();
+        cpu.solver.stopToken = cpu.stopToken;
+        searchThread = thread([this, timeInMicro, nodes]() {
+            auto start = steady_clock::now();
+            int result = cpu.solver.solve(searchGame, timeInMicro, nodes);
+            long time = duration_cast<milliseconds>(steady_clock::now() - start).count();
+            stringstream ss;
+            ss << "info time " << time << " nodes " << cpu.solver.nodes << " nps " << (time > 0 ? 1000L * cpu.solver.nodes / time : 0);
+            send(ss.str());
+            if (result == DFPN_WIN) send("solution win " + cpu.solver.move);
+            else if (result == DFPN_NO_WIN) send("solution none");
+            else send("solution unknown");
+        });
+    }
+
+    // latest snapshot of the current search, nothing if it has none yet
+    void sendInfo() {
+        AnalysisSnapshot snapshot;
+        if (!cpu.snapshots.read(snapshot) || snapshot.search != cpu.searches) return;
+        stringstream ss;
+        ss << "info time " << snapshot.time << " visits " << snapshot.visits << " nodes " << snapshot.nodes
+           << " nps " << snapshot.nps << " depth " << snapshot.depth;
+        if (snapshot.evalHits >= 0) ss << " evalhits " << snapshot.evalHits;
+        send(ss.str());
+        for (int i=0; i < snapshot.lines; i++) {
+            auto & line = snapshot.line[i];
+            stringstream ls;
+            ls << "info multipv " << (i+1) << " move " << line.move << " winrate " << line.winRate
+               << " visits " << line.visits << " pv " << line.pv;
+            send(ls.str());
+        }
+    }
+
+    void stopSearch() {
+        if (searchThread.joinable()) {
+            cpu.stop();
+            searchThread.join();
+        }
+    }
+};
+
+#endif // PROTOCOL_H
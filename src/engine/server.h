@@ -0,0 +1,280 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <climits>
+#include "cpumctstt.h"
+#include "openingbook.h"
+#include "options.h"
+#include "protocol.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Many games in one process (PaperSoccerEngine server). Commands on stdin, one per line, the
+// game ones start with a game name chosen by the client:
+//   isready                                       -> readyok
+//   <game> position ...                           like the engine protocol, creates the game
+//   <game> go [time <ms>] [clock <ms> [inc <ms>] [movestogo <n>]]
+//   <game> stop                                   -> its search returns the best move so far
+//   <game> close
+//   quit
+// Answers are "<game> info time .. visits .. nps .." and "<game> bestmove <move>".
+// The network (and its evaluation cache) is loaded once and shared. --slots searchers, one
+// thread each, share the --memory budget (MB) for their node pools, so the process never grows
+// with the number of games. A search waits in one queue until a searcher is free; the queue is
+// ordered by deadline, when the move is due by the game's time control, and the wait counts
+// against the game's clock, so games with less time go first and no game gets more than its
+// share of the cpu.
+class EngineServer {
+public:
+    explicit EngineServer(Options & options) : options(options) {
+        network = loadInferenceNetwork(options);
+        int slots = options.getInt("slots", thread::hardware_concurrency());
+        if (slots < 1) slots = 1;
+        size_t budget = (size_t)options.getLong("memory", 1024) << 20;
+        size_t nodeSize = sizeof(MoveMctsTTR2) + sizeof(SpinLock);
+        int poolSize = 1 << 16;
+        while ((size_t)poolSize * 2 * nodeSize * slots <= budget) poolSize *= 2;
+        moveTime = options.getLong("time", 1000);
+        if (options.has("book")) book.open(options.getString("book", "book"));
+
+        for (int i=0; i < slots; i++) {
+            CpuMctsTTRParallel *cpu = new CpuMctsTTRParallel(poolSize);
+            cpu->agent = network;
+            cpu->moveLimit = options.getInt("moveLimit", 750);
+            cpu->alpha = options.getFloat("alpha", cpu->alpha);
+            cpu->FPU = options.getFloat("FPU", cpu->FPU);
+            cpu->C = options.getFloat("C", cpu->C);
+            cpu->Croot = options.getFloat("Croot", cpu->Croot);
+            searchers.push_back(cpu);
+        }
+        cerr << slots << " searchers, " << poolSize << " nodes each" << endl;
+        for (int i=0; i < slots; i++) threads.emplace_back(&EngineServer::searcher, this, i);
+    }
+
+    virtual ~EngineServer() {
+        {
+            lock_guard<mutex> guard(queueLock);
+            closing = true;
+            for (auto & cpu : searchers) cpu->stop();
+        }
+        queueCondition.notify_all();
+        for (auto & t : threads) t.join();
+        for (auto & search : queue) delete search;
+        for (auto & cpu : searchers) delete cpu;
+        delete network;
+    }
+
+    void run(istream & in) {
+        string line;
+        while (getline(in, line)) {
+            stringstream tokens(line);
+            string name, command;
+            tokens >> name;
+            if (name == "quit") break;
+            if (name == "isready") {
+                send("readyok");
+                continue;
+            }
+            if (name.empty()) continue;
+            tokens >> command;
+            if (command == "position") setPosition(name, tokens);
+            else if (command == "go") go(name, tokens);
+            else if (command == "stop") stop(name);
+            else if (command == "close") close(name);
+            else send(name + " info string unknown command " + command);
+        }
+    }
+
+private:
+    struct Search {
+        string name;
+        Game game;
+        long deadline; // microseconds since the server started
+        long queued;
+        long timeInMicro; // without a clock
+        long clock, increment; // clock -1 if none
+        int movesToGo;
+        bool stopped = false;
+    };
+
+    struct GameState {
+        Game game;
+        bool searching = false;
+        bool closed = false; // while searching, removed when the search ends
+        int searcher = -1; // while its search runs
+        Search *queued = nullptr; // while it waits
+    };
+
+    Options & options;
+    INetwork *network;
+    OpeningBook book;
+    long moveTime;
+    vector<CpuMctsTTRParallel*> searchers;
+    vector<thread> threads;
+    steady_clock::time_point start = steady_clock::now();
+
+    // queue, games and searcher assignment
+    mutex queueLock;
+    condition_variable queueCondition;
+    vector<Search*> queue;
+    map<string,GameState> games;
+    bool closing = false;
+
+    mutex outputLock;
+
+    void send(const string & message) {
+        lock_guard<mutex> guard(outputLock);
+        cout << message << endl;
+    }
+
+    long now() {
+        return duration_cast<microseconds>(steady_clock::now() - start).count();
+    }
+
+    void setPosition(const string & name, stringstream & tokens) {
+        lock_guard<mutex> guard(queueLock);
+        GameState & state = games[name];
+        if (state.searching) {
+            send(name + " info string searching, position ignored");
+            return;
+        }
+        readPosition(tokens, state.game);
+    }
+
+    void go(const string & name, stringstream & tokens) {
+        Search *search = new Search();
+        search->name = name;
+        search->timeInMicro = moveTime * 1000L;
+        search->clock = -1;
+        search->increment = 0;
+        search->movesToGo = 30;
+        string token;
+        while (tokens >> token) {
+            if (token == "time") {
+                long ms; tokens >> ms;
+                search->timeInMicro = ms * 1000L;
+            } else if (token == "clock") {
+                long ms; tokens >> ms;
+                search->clock = ms * 1000L;
+            } else if (token == "inc") {
+                long ms; tokens >> ms;
+                search->increment = ms * 1000L;
+            } else if (token == "movestogo") {
+                tokens >> search->movesToGo;
+            }
+        }
+
+        {
+            lock_guard<mutex> guard(queueLock);
+            GameState & state = games[name];
+            if (state.searching) {
+                send(name + " info string already searching");
+                delete search;
+                return;
+            }
+            Game & game = state.game;
+            if (game.isOver()) {
+                send(name + " bestmove none");
+                delete search;
+                return;
+            }
+            player_t player = game.currentPlayer;
+            const BookEntry *entry = book.lookup(game);
+            if (entry != nullptr || game.pitch.isNextMoveGameover(player == ONE ? TWO : ONE)) {
+                send(name + " bestmove " + (entry != nullptr ? string(entry->move) : game.pitch.shortWinningMoveForPlayer(player)));
+                delete search;
+                return;
+            }
+
+            search->game = game;
+            search->queued = now();
+            long budget = search->timeInMicro;
+            if (search->clock >= 0) {
+                TimeManager share;
+                share.startClock(search->clock, search->increment, search->movesToGo);
+                budget = share.softLimit;
+            }
+            search->deadline = search->queued + budget;
+            state.searching = true;
+            state.queued = search;
+            queue.push_back(search);
+        }
+        queueCondition.notify_one();
+    }
+
+    void stop(const string & name) {
+        lock_guard<mutex> guard(queueLock);
+        auto it = games.find(name);
+        if (it == games.end()) return;
+        GameState & state = it->second;
+        if (state.queued != nullptr) {
+            // no time left, it's searched as soon as a searcher is free
+            state.queued->stopped = true;
+            state.queued->deadline = 0;
+        } else if (state.searcher >= 0) {
+            searchers[state.searcher]->stop();
+        }
+    }
+
+    void close(const string & name) {
+        stop(name);
+        lock_guard<mutex> guard(queueLock);
+        auto it = games.find(name);
+        if (it == games.end()) return;
+        if (it->second.searching) it->second.closed = true;
+        else games.erase(it);
+    }
+
+    void searcher(int index) {
+        CpuMctsTTRParallel *cpu = searchers[index];
+        while (true) {
+            Search *search;
+            {
+                unique_lock<mutex> guard(queueLock);
+                queueCondition.wait(guard, [&]() { return closing || !queue.empty(); });
+                if (closing) return;
+                auto earliest = min_element(queue.begin(), queue.end(), [](const Search *a, const Search *b) { return a->deadline < b->deadline; });
+                search = *earliest;
+                queue.erase(earliest);
+                GameState & state = games[search->name];
+                state.queued = nullptr;
+                state.searcher = index;
+                cpu->stopToken->reset();
+            }
+
+            long waited = now() - search->queued;
+            cpu->setGame(&search->game);
+            cpu->setPlayer(search->game.currentPlayer);
+            MoveMctsTTR2 *best;
+            if (search->stopped) best = cpu->getBestMove(1000, 1);
+            else if (search->clock >= 0) best = cpu->getBestMoveClock(max(0L, search->clock - waited), search->increment, search->movesToGo, 1);
+            else best = cpu->getBestMove(max(1000L, search->timeInMicro - waited), 1);
+
+            AnalysisSnapshot snapshot;
+            if (cpu->snapshots.read(snapshot)) {
+                stringstream ss;
+                ss << search->name << " info time " << (waited / 1000 + snapshot.time) << " visits " << snapshot.visits << " nps " << snapshot.nps;
+                send(ss.str());
+            }
+            send(search->name + " bestmove " + best->move);
+
+            lock_guard<mutex> guard(queueLock);
+            GameState & state = games[search->name];
+            state.searching = false;
+            state.searcher = -1;
+            if (state.closed) games.erase(search->name);
+            delete search;
+        }
+    }
+};
+
+#endif // SERVER_H
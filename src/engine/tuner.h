@@ -0,0 +1,228 @@
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include "match.h"
+
+using namespace std;
+
+class TunedParameter {
+public:
+    string name;
+    double value;
+    double step; // perturbation size at the first iteration
+    double minValue, maxValue;
+
+    explicit TunedParameter(const string & name, double value, double step, double minValue, double maxValue)
+        : name(name), value(value), step(step), minValue(minValue), maxValue(maxValue) {}
+
+    double clamp(double v) {
+        return min(max(v, minValue), maxValue);
+    }
+};
+
+// rewrites or adds keys in the [General] section of a QSettings ini file, other lines are kept
+void writeIniValues(const string & fileName, const vector<pair<string,string>> & values) {
+    vector<string> lines;
+    ifstream in(fileName);
+    string line;
+    while (getline(in, line)) lines.push_back(line);
+    in.close();
+
+    int general = -1, sectionEnd = lines.size();
+    for (int i=0; i < (int)lines.size(); i++) {
+        if (lines[i] == "[General]") {
+            general = i;
+        } else if (general >= 0 && i > general && !lines[i].empty() && lines[i][0] == '[') {
+            sectionEnd = i;
+            break;
+        }
+    }
+    if (general < 0) {
+        lines.insert(lines.begin(), "[General]");
+        general = 0;
+        sectionEnd = 1;
+    }
+
+    for (auto & kv : values) {
+        bool found = false;
+        for (int i=general+1; i < sectionEnd; i++) {
+            if (lines[i].compare(0, kv.first.size()+1, kv.first + "=") == 0) {
+                lines[i] = kv.first + "=" + kv.second;
+                found = true;
+            }
+        }
+        if (!found) {
+            int at = sectionEnd;
+            while (at > general+1 && lines[at-1].empty()) at--;
+            lines.insert(lines.begin() + at, kv.first + "=" + kv.second);
+            sectionEnd++;
+        }
+    }
+
+    ofstream out(fileName);
+    for (auto & l : lines) out << l << "\n";
+}
+
+// SPSA over the search parameters. Every iteration plays --games games between theta+c*delta
+// and theta-c*delta on all cores (engines and network are created once), then moves theta
+// along the measured score difference. State is checkpointed after every iteration and the
+// result is written to the ini read by the gui.
+class Tuner {
+public:
+    explicit Tuner(Options & options) : options(options), base(options, "") {
+        concurrency = options.getInt("concurrency", thread::hardware_concurrency());
+        if (concurrency < 1) concurrency = 1;
+        iterations = options.getInt("iterations", 1000);
+        gamesPerIteration = max(2, options.getInt("games", 2*concurrency));
+        openingSteps = options.getInt("openingSteps", 2);
+        rate = options.getFloat("rate", 1.0f);
+        checkpointFile = options.getString("checkpoint", "tune_state");
+        iniFile = options.getString("ini", "qtpapersoccer.ini");
+
+        vector<TunedParameter> all = {
+            TunedParameter("alpha", base.alpha, 0.05, 0.01, 1.0),
+            TunedParameter("FPU", base.FPU, 0.05, 0.0, 1.0),
+            TunedParameter("C", base.C, 0.1, 0.05, 3.0),
+            TunedParameter("Croot", base.Croot, 0.1, 0.05, 3.0),
+            TunedParameter("moveLimit", base.moveLimit, 100, 50, 5000)
+        };
+        string names = "," + options.getString("params", "alpha,FPU,C,Croot") + ",";
+        for (auto & p : all) {
+            if (names.find("," + p.name + ",") == string::npos) continue;
+            p.step = options.getFloat(p.name + "Step", p.step);
+            parameters.push_back(p);
+        }
+
+        base.negamax = false; // the tuned parameters are the MCTS ones
+        network = loadInferenceNetwork(options);
+        int poolSize = options.getInt("poolSize", 0); // 0: sized for --time
+        for (int i=0; i < 2*concurrency; i++) {
+            engines.push_back(new MatchPlayer(base, network, poolSize));
+        }
+    }
+
+    virtual ~Tuner() {
+        for (auto & e : engines) delete e;
+        delete network;
+    }
+
+    int run() {
+        loadCheckpoint();
+        Random random;
+        // usual SPSA gain sequences, A is 10% of the iterations
+        double A = 0.1 * iterations;
+        for (; iteration < iterations; iteration++) {
+            double ck = 1.0 / pow(iteration+1, 0.101);
+            double ak = rate / pow(A + iteration + 1, 0.602);
+
+            MatchEngine plus = base, minus = base;
+            vector<int> delta;
+            for (auto & p : parameters) {
+                int d = random.nextInt(2) ? 1 : -1;
+                delta.push_back(d);
+                set(plus, p.name, p.clamp(p.value + ck * p.step * d));
+                set(minus, p.name, p.clamp(p.value - ck * p.step * d));
+            }
+
+            double result = playIteration(plus, minus);
+            for (int i=0; i < (int)parameters.size(); i++) {
+                auto & p = parameters[i];
+                // a_i = rate * step_i^2 keeps the update in units of the parameter's step
+                double gradient = result / (2.0 * ck * p.step * delta[i]);
+                p.value = p.clamp(p.value + ak * p.step * p.step * gradient);
+            }
+
+            cout << "iteration " << (iteration+1) << " result " << result;
+            for (auto & p : parameters) cout << " " << p.name << " " << p.value;
+            cout << endl;
+            saveCheckpoint();
+        }
+
+        vector<pair<string,string>> values;
+        for (auto & p : parameters) {
+            stringstream ss;
+            if (p.name == "moveLimit") ss << (int)round(p.value);
+            else ss << p.value;
+            values.push_back(make_pair(p.name, ss.str()));
+        }
+        writeIniValues(iniFile, values);
+        cout << "written to " << iniFile << endl;
+        return 0;
+    }
+
+private:
+    Options & options;
+    MatchEngine base;
+    vector<TunedParameter> parameters;
+    INetwork *network;
+    vector<MatchPlayer*> engines;
+
+    int concurrency;
+    int iterations;
+    int gamesPerIteration;
+    int openingSteps;
+    double rate;
+    string checkpointFile;
+    string iniFile;
+    int iteration = 0;
+
+    void set(MatchEngine & engine, const string & name, double value) {
+        if (name == "alpha") engine.alpha = value;
+        else if (name == "FPU") engine.FPU = value;
+        else if (name == "C") engine.C = value;
+        else if (name == "Croot") engine.Croot = value;
+        else if (name == "moveLimit") engine.moveLimit = (int)round(value);
+    }
+
+    // score of plus minus score of minus, in [-1,1]
+    double playIteration(MatchEngine & plus, MatchEngine & minus) {
+        atomic<int> nextPair{0};
+        atomic<int> sum{0};
+        int pairs = gamesPerIteration / 2;
+        vector<thread> threads;
+        for (int th=0; th < concurrency; th++) {
+            threads.push_back(thread([&, th]() {
+                Random random(Random().nextLong() ^ (th+1));
+                auto & cpuMinus = *engines[2*th];
+                auto & cpuPlus = *engines[2*th+1];
+                while (nextPair.fetch_add(1) < pairs) {
+                    string opening = randomOpening(random, openingSteps);
+                    sum += playMatchGame(cpuMinus, minus, cpuPlus, plus, opening, ONE);
+                    sum += playMatchGame(cpuMinus, minus, cpuPlus, plus, opening, TWO);
+                }
+            }));
+        }
+        for (auto & t : threads) t.join();
+        return (double)sum / (2*pairs);
+    }
+
+    void loadCheckpoint() {
+        ifstream in(checkpointFile);
+        if (!in.good()) return;
+        string name;
+        double value;
+        while (in >> name >> value) {
+            if (name == "iteration") iteration = (int)value;
+            for (auto & p : parameters) {
+                if (p.name == name) p.value = value;
+            }
+        }
+        cout << "resumed from " << checkpointFile << " at iteration " << iteration << endl;
+    }
+
+    void saveCheckpoint() {
+        string temp = checkpointFile + ".tmp";
+        {
+            ofstream out(temp);
+            out.precision(9);
+            out << "iteration " << (iteration+1) << "\n";
+            for (auto & p : parameters) out << p.name << " " << p.value << "\n";
+        }
+        rename(temp.c_str(), checkpointFile.c_str());
+    }
+};
+
+#endif // TUNER_H
@@ -0,0 +1,83 @@
+#ifndef EVALCACHE_H
+#define EVALCACHE_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// Network values by position key (Pitch::getKey), shared by every thread and engine using
+// the network. Fixed size, one entry per bucket, always replaced. Entries are written without
+// locks as two words, the value and key^value; a torn or overwritten entry fails the xor check
+// and is just a miss. Must be cleared when the network weights change.
+class EvalCache {
+public:
+    explicit EvalCache(size_t megabytes) {
+        size_t count = 1;
+        while (2 * count * sizeof(Entry) <= (megabytes << 20)) count *= 2;
+        entries = count;
+        table.reset(new Entry[entries]);
+        clear();
+    }
+
+    void clear() {
+        for (size_t i=0; i < entries; i++) {
+            table[i].check.store(0, memory_order_relaxed);
+            table[i].data.store(0, memory_order_relaxed);
+        }
+        probes = 0;
+        hits = 0;
+    }
+
+    bool probe(uint64_t key, float & value) {
+        Entry & entry = table[key & (entries-1)];
+        uint64_t data = entry.data.load(memory_order_relaxed);
+        uint64_t check = entry.check.load(memory_order_relaxed);
+        if ((data & VALID) == 0 || (check ^ data) != key) return false;
+        uint32_t bits = (uint32_t)data;
+        memcpy(&value, &bits, sizeof(float));
+        return true;
+    }
+
+    void store(uint64_t key, float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(float));
+        uint64_t data = VALID | bits;
+        Entry & entry = table[key & (entries-1)];
+        entry.data.store(data, memory_order_relaxed);
+        entry.check.store(key ^ data, memory_order_relaxed);
+    }
+
+    // counted by the engines once per expansion, not per probe
+    void addStats(uint64_t probes, uint64_t hits) {
+        this->probes.fetch_add(probes, memory_order_relaxed);
+        this->hits.fetch_add(hits, memory_order_relaxed);
+    }
+
+    // percent of probes that were hits since the last clear
+    float hitRate() {
+        uint64_t p = probes.load(memory_order_relaxed);
+        return p == 0 ? 0 : 100.0f * hits.load(memory_order_relaxed) / p;
+    }
+
+    size_t size() {
+        return entries;
+    }
+
+private:
+    static const uint64_t VALID = 1ULL << 32;
+
+    struct Entry {
+        atomic<uint64_t> check;
+        atomic<uint64_t> data;
+    };
+
+    size_t entries;
+    unique_ptr<Entry[]> table;
+    atomic<uint64_t> probes{0};
+    atomic<uint64_t> hits{0};
+};
+
+#endif // EVALCACHE_H
@@ -187,6 +187,15 @@ public:
         }
     }
 
+    // replays a notation such as "24,7" (separators and result are ignored)
+    void loadNotation(const string & notation, player_t firstPlayer = TWO) {
+        currentPlayer = firstPlayer;
+        for (auto & c : notation) {
+            if (c < '0' || c > '7') continue;
+            makeMoveWithPlayer(c,true);
+        }
+    }
+
     void undoMove() {
         if (notation.size() > 0 && notation.back() == ',') {
             changePlayer();
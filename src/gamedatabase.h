@@ -0,0 +1,396 @@
+#ifndef GAMEDATABASE_H
+#define GAMEDATABASE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <cstring>
+#include <cstdint>
+#include "game.h"
+#include "sample.h"
+#include "samplefile.h"
+#include "random.h"
+#include "mappedfile.h"
+
+using namespace std;
+
+// Game database file: 64 byte header, the games table, the steps of all games packed in 3 bits
+// each (the direction chars '0'..'7', turns end where the rules say so), then the position
+// index sorted by key. Every game has one index entry per turn: the position at its start,
+// keyed by Pitch::getKey of the player to move. The checksum is over everything after the header.
+#define GAMEDB_MAGIC "PSGAMEDB"
+#define GAMEDB_VERSION 1
+
+struct GameDbHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t games;
+    uint64_t steps;
+    uint64_t positions;
+    uint32_t checksum;
+    char reserved[28];
+};
+
+static_assert(sizeof(GameDbHeader) == 64, "GameDbHeader must be 64 bytes");
+
+struct GameRecord {
+    uint64_t offset; // first step in the packed steps
+    uint32_t steps;
+    uint16_t turns;
+    uint8_t first; // player of the first turn
+    uint8_t winner; // NONE if the game is unfinished
+};
+
+static_assert(sizeof(GameRecord) == 16, "GameRecord must be 16 bytes");
+
+struct PositionRecord {
+    uint64_t key;
+    uint32_t game;
+    uint32_t turn;
+};
+
+static_assert(sizeof(PositionRecord) == 16, "PositionRecord must be 16 bytes");
+
+// bytes of packed steps, with room for the two byte reads and a multiple of 8 so the index
+// after them stays aligned
+inline size_t packedStepsSize(uint64_t steps) {
+    return ((steps * 3 + 7) / 8 + 2 + 7) & ~(size_t)7;
+}
+
+// Plays games step by step on one pitch, without the notation and history of Game, and takes
+// the steps back for the next game.
+class GameReplay {
+public:
+    Pitch pitch = Pitch(8,10);
+    player_t player = NONE;
+
+    GameReplay() : startBall(pitch.ball) {
+    }
+
+    void start(player_t first) {
+        for (int i=(int)path.size()-1; i >= 0; i--) pitch.removeEdge(i == 0 ? startBall : path[i-1], path[i]);
+        path.clear();
+        pitch.ball = startBall;
+        player = first;
+        over = false;
+        winner = NONE;
+    }
+
+    // false if the step is not legal; turnEnded tells if the other player moves next
+    bool step(int direction, bool & turnEnded) {
+        turnEnded = false;
+        if (over || direction < 0 || direction > 7) return false;
+        int n = pitch.nextNode(pitch.ball, '0' + direction);
+        if (n < 0 || pitch.matrix[pitch.ball * pitch.size + n] != 1) return false;
+        pitch.addEdge(pitch.ball, n);
+        pitch.ball = n;
+        path.push_back(n);
+        player_t goal = pitch.goal(n);
+        if (goal != NONE) {
+            over = true;
+            winner = goal == ONE ? TWO : ONE;
+        } else if (pitch.isBlocked(n)) {
+            over = true;
+            winner = player == ONE ? TWO : ONE;
+        } else if (!pitch.passNextDone(n)) {
+            player = player == ONE ? TWO : ONE;
+            turnEnded = true;
+        }
+        return true;
+    }
+
+    bool isOver() {
+        return over;
+    }
+
+    player_t getWinner() {
+        return winner;
+    }
+
+private:
+    int startBall;
+    vector<int> path;
+    bool over = false;
+    player_t winner = NONE;
+};
+
+// Games for the database, each a notation ("24,7 A") and the player of its first turn
+struct GameSource {
+    string notation;
+    player_t first;
+};
+
+// Read-only mapping of a game database. Queries are safe from any thread.
+class GameDatabase {
+public:
+    GameDatabase() {}
+
+    GameDatabase(const GameDatabase &) = delete;
+    GameDatabase & operator=(const GameDatabase &) = delete;
+
+    // maps the file and checks header, size and checksum, prints the reason on failure
+    bool open(const string & fileName) {
+        if (!file.open(fileName)) return fail(fileName, "cannot open");
+        if (file.size < sizeof(GameDbHeader)) return fail(fileName, "too short");
+        memcpy(&header, file.data, sizeof(GameDbHeader));
+        if (memcmp(header.magic, GAMEDB_MAGIC, 8) != 0) return fail(fileName, "not a game database");
+        if (header.version != GAMEDB_VERSION) return fail(fileName, "unsupported version " + to_string(header.version));
+        size_t size = sizeof(GameDbHeader) + header.games * sizeof(GameRecord) + packedStepsSize(header.steps) + header.positions * sizeof(PositionRecord);
+        if (file.size != size) return fail(fileName, "size does not match the header");
+        if (fnv1a(file.data + sizeof(GameDbHeader), size - sizeof(GameDbHeader)) != header.checksum) return fail(fileName, "checksum mismatch");
+        gameRecords = (const GameRecord*)(file.data + sizeof(GameDbHeader));
+        steps = (const uint8_t*)(gameRecords + header.games);
+        positions = (const PositionRecord*)(steps + packedStepsSize(header.steps));
+        return true;
+    }
+
+    int games() {
+        return header.games;
+    }
+
+    long positionCount() {
+        return header.positions;
+    }
+
+    const GameRecord & game(int index) {
+        return gameRecords[index];
+    }
+
+    // direction of the i-th step of the game, 0..7
+    int step(const GameRecord & record, uint32_t i) {
+        uint64_t bit = (record.offset + i) * 3;
+        return ((steps[bit >> 3] | (steps[(bit >> 3) + 1] << 8)) >> (bit & 7)) & 7;
+    }
+
+    // index entries of the position, one per game reaching it
+    pair<const PositionRecord*, const PositionRecord*> find(uint64_t key) {
+        const PositionRecord *end = positions + header.positions;
+        const PositionRecord *first = lower_bound(positions, end, key, [](const PositionRecord & p, uint64_t k) { return p.key < k; });
+        const PositionRecord *last = first;
+        while (last != end && last->key == key) last++;
+        return {first, last};
+    }
+
+    // games reaching the position, which has to be at the start of a turn like the indexed ones
+    vector<uint32_t> gamesReaching(Game & game) {
+        vector<uint32_t> result;
+        auto range = find(game.pitch.getKey(game.currentPlayer));
+        for (auto p = range.first; p != range.second; p++) result.push_back(p->game);
+        return result;
+    }
+
+    // outcomes of the games reaching the position, wins and losses of the player to move
+    struct Stats {
+        int games = 0;
+        int wins = 0;
+        int losses = 0;
+        int unfinished = 0;
+    };
+
+    Stats stats(Game & game) {
+        Stats stats;
+        auto range = find(game.pitch.getKey(game.currentPlayer));
+        for (auto p = range.first; p != range.second; p++) {
+            const GameRecord & record = gameRecords[p->game];
+            stats.games++;
+            if (record.winner == NONE) stats.unfinished++;
+            else if (record.winner == game.currentPlayer) stats.wins++;
+            else stats.losses++;
+        }
+        return stats;
+    }
+
+    // notation of the game like Game writes it
+    string notation(int index) {
+        const GameRecord & record = gameRecords[index];
+        GameReplay replay;
+        replay.start(record.first);
+        string notation;
+        for (uint32_t i=0; i < record.steps; i++) {
+            int direction = step(record, i);
+            bool turnEnded;
+            replay.step(direction, turnEnded);
+            notation += '0' + direction;
+            if (turnEnded) notation += ',';
+        }
+        if (record.winner != NONE) notation += record.winner == ONE ? " A" : " B";
+        return notation;
+    }
+
+    // Training samples of every finished game on threads: the position at the start of each turn
+    // with the result from the view of the player to move, as value too (there is no search
+    // value). Returns the number of samples.
+    long extractSamples(SampleWriter & writer, int threads) {
+        mutex writerLock;
+        long total = 0;
+        vector<thread> workers;
+        for (int th=0; th < threads; th++) {
+            workers.emplace_back([&, th]() {
+                GameReplay replay;
+                vector<TrainingSample> samples;
+                for (int g=th; g < (int)header.games; g += threads) {
+                    const GameRecord & record = gameRecords[g];
+                    if (record.winner == NONE) continue;
+                    samples.clear();
+                    replay.start(record.first);
+                    bool turnStart = true;
+                    for (uint32_t i=0; i < record.steps; i++) {
+                        if (turnStart) {
+                            float value = replay.player == record.winner ? 1 : -1;
+                            samples.push_back(TrainingSample::fromPitch(replay.pitch, replay.player, value));
+                            samples.back().result = (int8_t)value;
+                        }
+                        replay.step(step(record, i), turnStart);
+                    }
+                    lock_guard<mutex> guard(writerLock);
+                    for (auto & sample : samples) writer.add(sample);
+                    total += samples.size();
+                }
+            });
+        }
+        for (auto & worker : workers) worker.join();
+        writer.flush();
+        return total;
+    }
+
+    // Replays and indexes the games on threads, each taking a contiguous share, and writes the
+    // database. Games with an illegal step are left out and counted in skipped.
+    static bool build(const vector<GameSource> & sources, const string & fileName, int threads, int & skipped) {
+        if (threads < 1) threads = 1;
+        vector<Part> parts(threads);
+        vector<thread> workers;
+        size_t share = (sources.size() + threads - 1) / threads;
+        for (int th=0; th < threads; th++) {
+            size_t from = min(sources.size(), th * share), to = min(sources.size(), from + share);
+            workers.emplace_back(&GameDatabase::replayPart, cref(sources), from, to, ref(parts[th]));
+        }
+        for (auto & worker : workers) worker.join();
+
+        GameDbHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, GAMEDB_MAGIC, 8);
+        header.version = GAMEDB_VERSION;
+        skipped = 0;
+        vector<GameRecord> records;
+        for (auto & part : parts) {
+            for (auto & record : part.games) {
+                record.offset += header.steps;
+                records.push_back(record);
+            }
+            for (auto & position : part.positions) position.game += header.games;
+            header.games += part.games.size();
+            header.steps += part.steps.size();
+            header.positions += part.positions.size();
+            skipped += part.skipped;
+        }
+
+        vector<uint8_t> packed(packedStepsSize(header.steps), 0);
+        uint64_t bit = 0;
+        for (auto & part : parts) {
+            for (auto & direction : part.steps) {
+                packed[bit >> 3] |= direction << (bit & 7);
+                if ((bit & 7) > 5) packed[(bit >> 3) + 1] |= direction >> (8 - (bit & 7));
+                bit += 3;
+            }
+            vector<uint8_t>().swap(part.steps);
+        }
+
+        // the parts are sorted, merge them pairwise
+        vector<PositionRecord> index;
+        index.reserve(header.positions);
+        vector<size_t> bounds = {0};
+        for (auto & part : parts) {
+            index.insert(index.end(), part.positions.begin(), part.positions.end());
+            vector<PositionRecord>().swap(part.positions);
+            bounds.push_back(index.size());
+        }
+        auto byKey = [](const PositionRecord & a, const PositionRecord & b) { return a.key != b.key ? a.key < b.key : a.game < b.game; };
+        while (bounds.size() > 2) {
+            vector<size_t> merged = {0};
+            for (size_t i=0; i+2 < bounds.size(); i += 2) {
+                inplace_merge(index.begin() + bounds[i], index.begin() + bounds[i+1], index.begin() + bounds[i+2], byKey);
+                merged.push_back(bounds[i+2]);
+            }
+            if (bounds.size() % 2 == 0) merged.push_back(bounds.back());
+            bounds = merged;
+        }
+
+        uint32_t checksum = fnv1a((const uint8_t*)records.data(), records.size() * sizeof(GameRecord));
+        checksum = fnv1a(packed.data(), packed.size(), checksum);
+        header.checksum = fnv1a((const uint8_t*)index.data(), index.size() * sizeof(PositionRecord), checksum);
+
+        ofstream plik(fileName, ios::out | ios::binary | ios::trunc);
+        plik.write((const char*)&header, sizeof(header));
+        plik.write((const char*)records.data(), records.size() * sizeof(GameRecord));
+        plik.write((const char*)packed.data(), packed.size());
+        plik.write((const char*)index.data(), index.size() * sizeof(PositionRecord));
+        return plik.good();
+    }
+
+private:
+    MappedFile file;
+    GameDbHeader header;
+    const GameRecord *gameRecords = nullptr;
+    const uint8_t *steps = nullptr;
+    const PositionRecord *positions = nullptr;
+
+    // one thread's share of a build, offsets and game numbers relative to it
+    struct Part {
+        vector<GameRecord> games;
+        vector<uint8_t> steps;
+        vector<PositionRecord> positions;
+        int skipped = 0;
+    };
+
+    static void replayPart(const vector<GameSource> & sources, size_t from, size_t to, Part & part) {
+        GameReplay replay;
+        for (size_t s=from; s < to; s++) {
+            const GameSource & source = sources[s];
+            GameRecord record;
+            record.offset = part.steps.size();
+            record.steps = 0;
+            record.turns = 0;
+            record.first = source.first;
+            size_t positionsBefore = part.positions.size();
+            replay.start(source.first);
+            bool turnStart = true, legal = true;
+            player_t resigned = NONE;
+            for (auto & c : source.notation) {
+                if (c == 'A' || c == 'B') resigned = c == 'A' ? ONE : TWO; // winner, also without an ending step
+                if (c < '0' || c > '7') continue;
+                if (turnStart) {
+                    part.positions.push_back({replay.pitch.getKey(replay.player), (uint32_t)part.games.size(), record.turns});
+                    record.turns++;
+                }
+                if (!replay.step(c - '0', turnStart)) {
+                    legal = false;
+                    break;
+                }
+                part.steps.push_back(c - '0');
+                record.steps++;
+            }
+            if (!legal || record.steps == 0) {
+                part.steps.resize(record.offset);
+                part.positions.resize(positionsBefore);
+                part.skipped++;
+                continue;
+            }
+            record.winner = replay.isOver() ? replay.getWinner() : resigned;
+            part.games.push_back(record);
+        }
+        sort(part.positions.begin(), part.positions.end(), [](const PositionRecord & a, const PositionRecord & b) {
+            return a.key != b.key ? a.key < b.key : a.game < b.game;
+        });
+    }
+
+    bool fail(const string & fileName, const string & reason) {
+        cerr << "game database " << fileName << ": " << reason << endl;
+        return false;
+    }
+};
+
+#endif // GAMEDATABASE_H
@@ -0,0 +1,311 @@
+#ifndef INFERENCE_H
+#define INFERENCE_H
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "network.h"
+
+using namespace std;
+
+// Network used only to play. Holds the weights and nothing for training (no momentum, no
+// adaptive rates), so it is about a quarter of a Network. Float weight files are used in
+// place from the mapping, anything else is copied into 64 byte aligned arrays with every
+// layer starting on a 64 byte boundary. Nothing changes after loading, so one instance is
+// shared by all threads and engines, each with its own EvalContext.
+class InferenceNetwork : public INetwork {
+public:
+    const int architecture, inputs, hidden, hidden2;
+
+    // copy of a trainer's network
+    explicit InferenceNetwork(Network *network) : InferenceNetwork(network->architecture(), network->inputs, network->hidden,
+                                                                    network->architecture() == NET_DEEP ? network->outputWeights.size() : 0) {
+        type = network->type;
+        auto arrays = network->weightArrays();
+        allocate();
+        float *p = weights.data;
+        for (auto & a : arrays) {
+            memcpy(p, a->data(), a->size() * sizeof(float));
+            p += padded(a->size());
+        }
+    }
+
+    virtual ~InferenceNetwork() {
+        delete file;
+    }
+
+    InferenceNetwork(const InferenceNetwork &) = delete;
+    InferenceNetwork & operator=(const InferenceNetwork &) = delete;
+
+    // network described by the header of a weight file, old raw files are NetworkDeep
+    // of the given dimensions; nullptr if the file cannot be used
+    static InferenceNetwork* load(const string & fileName, int hidden = 96, int hidden2 = 32) {
+        cerr << "load " << fileName << endl;
+        if (!WeightFile::hasHeader(fileName)) return loadRaw(fileName, hidden, hidden2);
+
+        WeightFile *file = new WeightFile();
+        if (!file->open(fileName)) {
+            delete file;
+            return nullptr;
+        }
+        auto & h = file->header;
+        InferenceNetwork *network = new InferenceNetwork(h.architecture, h.inputs, h.hidden, h.architecture == NET_DEEP ? h.hidden2 : 0);
+        network->type = h.inputType;
+        if (file->floats() != nullptr) {
+            const float *p = file->floats();
+            network->hiddenWeights = p;
+            network->hiddenWeights2 = p + (size_t)h.inputs * h.hidden;
+            network->outputWeights = network->hiddenWeights2 + (size_t)h.hidden * network->hidden2;
+            network->file = file;
+            return network;
+        }
+        network->allocate();
+        size_t offset = 0;
+        float *p = network->weights.data;
+        for (size_t size : network->arraySizes()) {
+            file->read(offset, p, size);
+            offset += size;
+            p += padded(size);
+        }
+        delete file;
+        return network;
+    }
+
+    virtual void cacheScore(const vector<int> & indexes, EvalContext & context) {
+        context.prepare(hidden, hidden2);
+        float *accumulator = context.accumulator;
+        for (int i=0; i < hidden; i++) {
+            accumulator[i] = 0;
+        }
+        for (auto & index : indexes) {
+            const float *row = &hiddenWeights[(size_t)index * hidden];
+            for (int i=0; i < hidden; i++) {
+                accumulator[i] += row[i];
+            }
+        }
+    }
+
+    virtual float getScoreDiff(const vector<int> & indexesBase, const vector<int> & indexes, EvalContext & context) {
+        float *scores = context.scores;
+        memcpy(scores, context.accumulator, hidden * sizeof(float));
+        for (auto & index : indexesBase) {
+            const float *row = &hiddenWeights[(size_t)index * hidden];
+            for (int i=0; i < hidden; i++) {
+                scores[i] -= row[i];
+            }
+        }
+        for (auto & index : indexes) {
+            const float *row = &hiddenWeights[(size_t)index * hidden];
+            for (int i=0; i < hidden; i++) {
+                scores[i] += row[i];
+            }
+        }
+        return output(context);
+    }
+
+    virtual float getScore(const vector<int> & indexes, EvalContext & context) {
+        context.prepare(hidden, hidden2);
+        float *scores = context.scores;
+        for (int i=0; i < hidden; i++) {
+            scores[i] = 0;
+        }
+        for (auto & index : indexes) {
+            const float *row = &hiddenWeights[(size_t)index * hidden];
+            for (int i=0; i < hidden; i++) {
+                scores[i] += row[i];
+            }
+        }
+        return output(context);
+    }
+
+    // Children of a node in blocks of EVAL_BATCH: first layer sums position by position, then
+    // the second layer as one matrix product over the block, so each weight row is read once
+    // per block instead of once per position.
+    virtual void getScoresDiff(EvalBatch & batch, EvalContext & context) {
+        int n = batch.size();
+        batch.scores.resize(n);
+        for (int start=0; start < n; start += EVAL_BATCH) {
+            int count = min(EVAL_BATCH, n - start);
+            for (int r=0; r < count; r++) {
+                float *row = &context.rows[r*hidden];
+                memcpy(row, context.accumulator, hidden * sizeof(float));
+                for (int k=batch.offsets[start+r]; k < batch.offsets[start+r+1]; k++) {
+                    const float *w = &hiddenWeights[(size_t)batch.indexes[k] * hidden];
+                    for (int i=0; i < hidden; i++) {
+                        row[i] += w[i];
+                    }
+                }
+                activate(row);
+            }
+
+            if (architecture != NET_DEEP) {
+                for (int r=0; r < count; r++) {
+                    batch.scores[start+r] = top(&context.rows[r*hidden]);
+                }
+                continue;
+            }
+
+            float *rows2 = context.rows2;
+            for (int i=0; i < count * hidden2; i++) {
+                rows2[i] = 0;
+            }
+            // four positions at a time, every weight loaded once for all four
+            int r = 0;
+            for (; r + 4 <= count; r += 4) {
+                const float *in = &context.rows[r*hidden];
+                float *out0 = &rows2[r*hidden2];
+                float *out1 = out0 + hidden2;
+                float *out2 = out1 + hidden2;
+                float *out3 = out2 + hidden2;
+                for (int i=0; i < hidden; i++) {
+                    const float *w = &hiddenWeights2[i*hidden2];
+                    float s0 = in[i], s1 = in[hidden+i], s2 = in[2*hidden+i], s3 = in[3*hidden+i];
+                    for (int j=0; j < hidden2; j++) {
+                        out0[j] += w[j] * s0;
+                        out1[j] += w[j] * s1;
+                        out2[j] += w[j] * s2;
+                        out3[j] += w[j] * s3;
+                    }
+                }
+            }
+            for (; r < count; r++) {
+                float *out = &rows2[r*hidden2];
+                for (int i=0; i < hidden; i++) {
+                    const float *w = &hiddenWeights2[i*hidden2];
+                    float s = context.rows[r*hidden+i];
+                    for (int j=0; j < hidden2; j++) {
+                        out[j] += w[j] * s;
+                    }
+                }
+            }
+            for (int r=0; r < count; r++) {
+                batch.scores[start+r] = top(&rows2[r*hidden2]);
+            }
+        }
+    }
+
+private:
+    const float *hiddenWeights = nullptr;
+    const float *hiddenWeights2 = nullptr;
+    const float *outputWeights = nullptr;
+    AlignedFloats weights;
+    WeightFile *file = nullptr; // mapping the weights point into, if any
+
+    explicit InferenceNetwork(int architecture, int inputs, int hidden, int hidden2)
+        : architecture(architecture), inputs(inputs), hidden(hidden), hidden2(hidden2) {
+    }
+
+    static size_t padded(size_t size) {
+        return (size + 15) & ~(size_t)15;
+    }
+
+    // weight arrays in file order, as in Network::weightArrays
+    vector<size_t> arraySizes() {
+        if (architecture == NET_DEEP) return { (size_t)inputs * hidden, (size_t)hidden * hidden2, (size_t)hidden2 };
+        return { (size_t)inputs * hidden, (size_t)hidden };
+    }
+
+    void allocate() {
+        auto sizes = arraySizes();
+        size_t total = 0;
+        for (auto & size : sizes) total += padded(size);
+        weights.resize(total);
+        hiddenWeights = weights.data;
+        hiddenWeights2 = hiddenWeights + padded(sizes[0]);
+        outputWeights = architecture == NET_DEEP ? hiddenWeights2 + padded(sizes[1]) : hiddenWeights2;
+    }
+
+    static InferenceNetwork* loadRaw(const string & fileName, int hidden, int hidden2) {
+        InferenceNetwork *network = new InferenceNetwork(NET_DEEP, 1466, hidden, hidden2);
+        network->type = 2;
+        auto sizes = network->arraySizes();
+        size_t expected = 0;
+        for (auto & size : sizes) expected += size;
+
+        ifstream plik(fileName, ios::binary | ios::ate);
+        if (!plik.good()) {
+            cerr << "cannot load " << fileName << ": cannot open" << endl;
+            delete network;
+            return nullptr;
+        }
+        if ((size_t)plik.tellg() != expected * sizeof(float)) {
+            cerr << "cannot load " << fileName << ": size does not match the network dimensions" << endl;
+            delete network;
+            return nullptr;
+        }
+        plik.seekg(0);
+        network->allocate();
+        float *p = network->weights.data;
+        for (auto & size : sizes) {
+            plik.read((char*)p, sizeof(float) * size);
+            p += padded(size);
+        }
+        return network;
+    }
+
+    // activations as in Network, NetworkScrelu and NetworkDeep
+    void activate(float *scores) {
+        if (architecture == NET_PLAIN) {
+            for (int i=0; i < hidden; i++) {
+                scores[i] = scores[i] < 0 ? 0.01f * scores[i] : scores[i];
+            }
+        } else if (architecture == NET_SCRELU) {
+            for (int i=0; i < hidden; i++) {
+                float x = scores[i];
+                scores[i] = x < 0 ? 0.01f * x : x > 1 ? 0.99f + 0.01f * x : x*x;
+            }
+        } else {
+            for (int i=0; i < hidden; i++) {
+                float x = scores[i];
+                scores[i] = x < 0 ? 0.01f * x : x*x;
+            }
+        }
+    }
+
+    // output from the activated last hidden layer
+    float top(const float *scores) {
+        float output = 0;
+        if (architecture != NET_DEEP) {
+            for (int i=0; i < hidden; i++) {
+                output += outputWeights[i] * scores[i];
+            }
+        } else {
+            for (int i=0; i < hidden2; i++) {
+                float x = scores[i] < 0 ? 0.01f * scores[i] : scores[i];
+                output += outputWeights[i] * x;
+            }
+        }
+        return fast_tanh(output);
+    }
+
+    // layers above the first one
+    float output(EvalContext & context) {
+        float *scores = context.scores;
+        activate(scores);
+        if (architecture != NET_DEEP) return top(scores);
+
+        float *scores2 = context.scores2;
+        for (int i=0; i < hidden2; i++) {
+            scores2[i] = 0;
+        }
+        for (int i=0; i < hidden; i++) {
+            const float *w = &hiddenWeights2[i*hidden2];
+            float s = scores[i];
+            for (int j=0; j < hidden2; j++) {
+                scores2[j] += w[j] * s;
+            }
+        }
+        return top(scores2);
+    }
+
+    float fast_tanh(float x) {
+        if (x > 4.95f) return 1;
+        if (x < -4.95f) return -1;
+        float x2 = x * x;
+        float a = x * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2)));
+        float b = 135135.0f + x2 * (62370.0f + x2 * (3150.0f + x2 * 28.0f));
+        return a / b;
+    }
+};
+
+#endif // INFERENCE_H
@@ -18,6 +18,14 @@ MainWindow::MainWindow(QWidget *parent)
     settings.setValue("poolSize",poolSize);
     int moveLimit = settings.value("moveLimit", 750).toInt();
     settings.setValue("moveLimit",moveLimit);
+    float alpha = settings.value("alpha", 0.35).toFloat();
+    settings.setValue("alpha",alpha);
+    float FPU = settings.value("FPU", 0.5).toFloat();
+    settings.setValue("FPU",FPU);
+    float C = settings.value("C", 0.95).toFloat();
+    settings.setValue("C",C);
+    float Croot = settings.value("Croot", 1.0).toFloat();
+    settings.setValue("Croot",Croot);
     bool kurnikColors = settings.value("kurnikColors", false).toBool();
     settings.setValue("kurnikColors",kurnikColors);
     int hidden = settings.value("hidden", 96).toInt();
@@ -26,12 +34,24 @@ MainWindow::MainWindow(QWidget *parent)
     settings.setValue("hidden2",hidden2);
     QString netfile = settings.value("netfile","96_32_net").toString();
     settings.setValue("netfile",netfile);
+    int evalCache = settings.value("evalCache", 16).toInt();
+    settings.setValue("evalCache",evalCache);
     cpuParallel = new CpuMctsTTRParallel(poolSize);
     cpuParallel->moveLimit = moveLimit;
-    Network* network = new NetworkDeep(1466,hidden,hidden2);
-    network->load(netfile.toStdString());
-    network->type = 2;
+    cpuParallel->alpha = alpha;
+    cpuParallel->FPU = FPU;
+    cpuParallel->C = C;
+    cpuParallel->Croot = Croot;
+    INetwork* network = InferenceNetwork::load(netfile.toStdString(),hidden,hidden2);
+    if (network == nullptr) {
+        QMessageBox::critical(this, "PaperSoccer", "Cannot load network " + netfile + ", check netfile, hidden and hidden2 in qtpapersoccer.ini.");
+        exit(1);
+    }
+    if (evalCache > 0) network->cache = new EvalCache(evalCache);
     cpuParallel->agent = network;
+    QString bookfile = settings.value("book","book").toString();
+    settings.setValue("book",bookfile);
+    if (!bookfile.isEmpty() && QFile::exists(bookfile)) book.open(bookfile.toStdString());
 
     qRegisterMetaType<string>("string");
 
@@ -41,6 +61,8 @@ MainWindow::MainWindow(QWidget *parent)
     connect(this, SIGNAL(sendNotation2(string)), &secondWindow, SLOT(onNotation2(string)));
     connect(this, SIGNAL(sendGameState(bool)), &secondWindow, SLOT(onGameStateChanged(bool)));
     connect(this, SIGNAL(sendWinner(int)), &secondWindow, SLOT(onWinner(int)));
+    connect(this, SIGNAL(sendAnalysis(string)), &secondWindow, SLOT(onAnalysis(string)));
+    connect(&analysisTimer, SIGNAL(timeout()), this, SLOT(onAnalysisTimer()));
     connect(&secondWindow, SIGNAL(startClicked(string)), this, SLOT(onStartClicked(string)));
     secondWindow.show();
 }
@@ -92,6 +114,11 @@ void MainWindow::keyPressEvent(QKeyEvent *event) {
     //     repaint();
     //     return;
     // }
+    if ((event->key() == Qt::Key_Shift && analysing) || (event->key() == Qt::Key_Escape && calculating)) {
+        // second press ends the analysis, escape any search, the best move so far is played
+        cpuParallel->stop();
+        return;
+    }
     if (!game->started || calculating || (game->isOver() && !game->almost)) return;
     if (event->key() == Qt::Key_Backspace) {
         if (game->notation.size() == 0) {
@@ -121,7 +148,7 @@ void MainWindow::keyPressEvent(QKeyEvent *event) {
     }
     if (game->isOver() || !game->started || game->almost || calculating) return;
     if (event->key() == Qt::Key_Shift) {
-        calcMove(true);
+        calcMove(true, true);
         return;
     }
     return;
@@ -152,7 +179,6 @@ void MainWindow::keyPressEvent(QKeyEvent *event) {
             MctsCpu cpu; cpu.setGame(game); cpu.setPlayer(game->currentPlayer);
             auto move = cpu.getBestMove(500 * 1000);
             game->makeMove(move->move,game->currentPlayer);
-            delete move;
         }
     }
     repaint();
@@ -458,11 +484,7 @@ void MainWindow::onStartClicked(string notation) {
     game->started = true;
     bool cpuStart = false;
     if (notation.size() > 0) {
-        game->currentPlayer = TWO;
-        for (auto & c : notation) {
-            if (c < '0' || c > '7') continue;
-            game->makeMoveWithPlayer(c,true);
-        }
+        game->loadNotation(notation);
         humanPlayer = game->currentPlayer;
     } else {
         humanPlayer = humanPlayer == ONE ? TWO : ONE;
@@ -483,17 +505,23 @@ void MainWindow::onStartClicked(string notation) {
     }
 }
 
-void MainWindow::calcMove(bool forHuman) {
+void MainWindow::calcMove(bool forHuman, bool infinite) {
     calculating = true;
-    if (forHuman) {
+    if (infinite) {
+        emit sendMessage("Analysing, press Shift again to play the best move...");
+    } else if (forHuman) {
         emit sendMessage("Calculating move for human...");
     } else {
         emit sendMessage("Calculating move...");
     }
     cpuParallel->setGame(game);
     cpuParallel->setPlayer(game->currentPlayer);
+    cpuParallel->stopToken->reset();
+    cpuParallel->snapshotInterval = infinite ? 500 : 0;
+    analysing = infinite;
+    if (infinite) analysisTimer.start(500);
     // Create an instance of your woker
-    WorkerThread *workerThread = new WorkerThread(game,cpuParallel);
+    WorkerThread *workerThread = new WorkerThread(game,cpuParallel,infinite,&book);
     // Connect our signal and slot
     if (forHuman) {
         connect(workerThread, SIGNAL(moveCalculated(char)),
@@ -507,3 +535,15 @@ void MainWindow::calcMove(bool forHuman) {
             SLOT(deleteLater()));
     workerThread->start();
 }
+
+// shows the latest snapshot of the analysis, the search goes on meanwhile
+void MainWindow::onAnalysisTimer() {
+    AnalysisSnapshot snapshot;
+    if (!cpuParallel->snapshots.read(snapshot) || snapshot.search != cpuParallel->searches) return;
+    if (snapshot.finished) {
+        analysisTimer.stop();
+        analysing = false;
+        return;
+    }
+    emit sendAnalysis(snapshot.toString());
+}
@@ -14,6 +14,9 @@
 #include <math.h>
 #include <QThread>
 #include <QPushButton>
+#include <QMessageBox>
+#include <QTimer>
+#include <QFile>
 
 #define LINE_WIDTH 2
 #define BOLD_LINE_WIDTH 3
@@ -23,6 +26,7 @@
 #include "game.h"
 #include "cpu.h"
 #include "cpumctstt.h"
+#include "inference.h"
 #include "mctscpu.h"
 #include "secondwindow.h"
 #include "workerthread.h"
@@ -53,6 +57,7 @@ private:
     player_t humanPlayer = ONE;
     Game *game = new Game();
     CpuMctsTTRParallel* cpuParallel;
+    OpeningBook book;
 
     double blocksize;
     double marginWidth;
@@ -62,13 +67,16 @@ private:
     int hoverY = -1;
 
     bool calculating = false;
-    void calcMove(bool forHuman);
+    bool analysing = false;
+    QTimer analysisTimer;
+    void calcMove(bool forHuman, bool infinite = false);
 
 public slots:
     void onMoveCalculated(char c);
     void onMoveCalculated2(char c);
     void onStartClicked(string notation);
     void onBack();
+    void onAnalysisTimer();
 
 
 signals:
@@ -77,5 +85,6 @@ signals:
     void sendNotation2(string notation);
     void sendGameState(bool inGame);
     void sendWinner(int winner);
+    void sendAnalysis(string text);
 };
 #endif // MAINWINDOW_H
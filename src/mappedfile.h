@@ -0,0 +1,80 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+// Read-only mapping of a whole file, processes mapping the same file share its pages.
+// Windows reads it into memory instead.
+class MappedFile {
+public:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+    MappedFile() {}
+
+    virtual ~MappedFile() {
+        close();
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    bool open(const string & fileName) {
+        close();
+#ifndef _WIN32
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (m == MAP_FAILED) return false;
+        mapped = m;
+        size = st.st_size;
+        data = (const uint8_t*)mapped;
+#else
+        ifstream plik(fileName, ios::binary);
+        if (!plik.good()) return false;
+        buffer.assign(istreambuf_iterator<char>(plik), istreambuf_iterator<char>());
+        size = buffer.size();
+        data = (const uint8_t*)buffer.data();
+#endif
+        return true;
+    }
+
+    void close() {
+#ifndef _WIN32
+        if (mapped != nullptr) munmap(mapped, size);
+        mapped = nullptr;
+#else
+        buffer.clear();
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+private:
+#ifndef _WIN32
+    void *mapped = nullptr;
+#else
+    vector<char> buffer;
+#endif
+};
+
+#endif // MAPPEDFILE_H
@@ -5,6 +5,8 @@
 #define LIMIT_MOVES_PLAYOUT 30
 #define VIRTUAL_LOSS 2
 #define EXP_C 0.65
+#define MCTS_POOL_CHUNK 4096
+#define MCTS_MERGE_PLAYOUTS 64 // playouts of a root parallel thread between merges
 // 1.4142
 #include <algorithm>
 #include <chrono>
@@ -35,17 +37,6 @@ public:
     }
 };
 
-class ShortMove {
-public:
-    float score;
-    string move;
-
-    explicit ShortMove(float score = 0, string move = "") : score(score), move(move) {
-
-    }
-
-};
-
 class MctsMove : public IMove {
 public:
     player_t player;
@@ -57,22 +48,27 @@ public:
     MctsMove *parent;
     vector<MctsMove*> children;
 
-    shared_ptr<SpinLock> lock;
+    SpinLock lock;
     int virtualLoss;
 
-    MctsMove(string move, player_t player, MctsMove *parent) : IMove(move), player(player), parent(parent) {
+    // nodes live in a MctsMovePool and are reset when reused
+    MctsMove() : IMove("") {
+    }
+
+    void reset(const string & move, player_t player, MctsMove *parent) {
+        this->move = move;
+        this->player = player;
+        this->parent = parent;
+        children.clear();
         score = 0;
         games = 0;
         terminal = false;
         heuristic = 0;
         virtualLoss = 0;
-        lock.reset(new SpinLock());
     }
 
-    virtual ~MctsMove() { for (auto & m : children) { delete m; } }
-
-    void updateScore(int score, bool isTerminal) {
-        lock->lock();
+    void updateScore(int score, bool isTerminal, bool locking = true) {
+        if (locking) lock.lock();
         if (!terminal) {
             if (isTerminal) {
                 this->score = score;
@@ -83,7 +79,7 @@ public:
             games++;
         }
         virtualLoss -= VIRTUAL_LOSS;
-        lock->unlock();
+        if (locking) lock.unlock();
     }
 
     bool operator < (const MctsMove& move) const {
@@ -99,6 +95,35 @@ public:
     }
 };
 
+// Nodes of one search. Chunks are kept and the nodes reused by the next search, with their
+// strings and children vectors, so a search in steady state does not allocate nodes.
+class MctsMovePool {
+public:
+    bool locking = true; // false if only one thread creates nodes
+
+    MctsMove* create(const string & move, player_t player, MctsMove *parent) {
+        if (locking) lock.lock();
+        if (used == chunks.size() * MCTS_POOL_CHUNK) {
+            chunks.emplace_back(new MctsMove[MCTS_POOL_CHUNK]);
+        }
+        MctsMove *node = &chunks[used / MCTS_POOL_CHUNK][used % MCTS_POOL_CHUNK];
+        used++;
+        if (locking) lock.unlock();
+        node->reset(move, player, parent);
+        return node;
+    }
+
+    // every node handed out so far may be reused
+    void clear() {
+        used = 0;
+    }
+
+private:
+    SpinLock lock;
+    vector<unique_ptr<MctsMove[]>> chunks;
+    size_t used = 0;
+};
+
 class MctsCpuWorker : public ICpu {
 public:
     bool kupa = false;
@@ -108,9 +133,11 @@ public:
     //protected:
     int limit;
     int limitPlayouts;
-    bool alreadyBlocking;
-    bool alreadyBlocked;
+    bool alreadyBlocking = false;
+    bool alreadyBlocked = false;
     bool provenEnd;
+    MctsMovePool *pool = nullptr;
+    bool shared = true; // other threads search the same tree, nodes are locked
 
     vector<MctsMove*> generateMoves(MctsMove* parent, player_t player) {
         vector<MctsMove*> moves; moves.reserve(50);
@@ -219,7 +246,7 @@ public:
                     game->pitch.ball = t;
                     game->pitch.removeEdge(t, n);
                     str += game->pitch.getDistanceChar(t, n);
-                    MctsMove *move = new MctsMove(str,player,parent);
+                    MctsMove *move = pool->create(str,player,parent);
                     if (score > TERMINAL_THRESHOLD) {
                         move->score = INF + score;
                         move->games = 1;
@@ -249,7 +276,7 @@ public:
         return moves;
     }
 
-    void selectAndExpand(vector<MctsMove*> moves, int games, int level) {
+    void selectAndExpand(const vector<MctsMove*> & moves, int games, int level) {
         vector<int> indexes;
         float maxArg = -2 * INF;
         float a,b;
@@ -284,11 +311,11 @@ public:
         }
 
         MctsMove *move = moves[indexes[ran.nextInt(indexes.size())]];
-        move->lock->lock();
+        if (shared) move->lock.lock();
         move->virtualLoss += VIRTUAL_LOSS;
         if (move->terminal) {
             move->virtualLoss -= VIRTUAL_LOSS;
-            move->lock->unlock();
+            if (shared) move->lock.unlock();
             if (move->score > INF/2) {
                 if (level == 0) {
                     provenEnd = true;
@@ -296,11 +323,11 @@ public:
                 }
                 MctsMove *parent = move->parent;
                 if (parent != nullptr) {
-                    parent->updateScore(-INF, true);
+                    parent->updateScore(-INF, true, shared);
                     parent = parent->parent;
                 }
                 while (parent != nullptr) {
-                    parent->updateScore(parent->player == move->player ? 1 : 0, false);
+                    parent->updateScore(parent->player == move->player ? 1 : 0, false, shared);
                     parent = parent->parent;
                 }
             } else {
@@ -319,21 +346,21 @@ public:
                         return;
                     }
                     if (parent != nullptr) {
-                        parent->updateScore(INF, true);
+                        parent->updateScore(INF, true, shared);
                         parent = parent->parent;
 
                         if (parent != nullptr) {
-                            parent->updateScore(-INF, true);
+                            parent->updateScore(-INF, true, shared);
                             parent = parent->parent;
                         }
                     }
                     while (parent != nullptr) {
-                        parent->updateScore(parent->player == move->player ? 0 : 1, false);
+                        parent->updateScore(parent->player == move->player ? 0 : 1, false, shared);
                         parent = parent->parent;
                     }
                 } else {
                     while (parent != nullptr) {
-                        parent->updateScore(parent->player == move->player ? 0 : 1, false);
+                        parent->updateScore(parent->player == move->player ? 0 : 1, false, shared);
                         parent = parent->parent;
                     }
                 }
@@ -347,18 +374,18 @@ public:
             if (move->children.empty()) {
                 move->children = generateMoves(move, move->player==ONE?TWO:ONE);
             }
-            move->lock->unlock();
+            if (shared) move->lock.unlock();
             selectAndExpand(move->children,move->games+1,level+1);
         } else {
             float score = simulateOne(move->player);
             move->score += score;
             move->games++;
             move->virtualLoss -= VIRTUAL_LOSS;
-            move->lock->unlock();
+            if (shared) move->lock.unlock();
 
             MctsMove *parent = move->parent;
             while (parent != nullptr) {
-                parent->updateScore(parent->player == move->player ? score : 1-score, false);
+                parent->updateScore(parent->player == move->player ? score : 1-score, false, shared);
                 parent = parent->parent;
             }
         }
@@ -369,58 +396,74 @@ public:
         }
     }
 
+    // Buffers of the playouts, kept between them: once grown a playout allocates nothing for
+    // its candidates, their notation or its undo log.
+    struct PlayoutMove {
+        float score;
+        int start, length; // in playoutChars
+    };
+    vector<PlayoutMove> playoutMoves;
+    string playoutChars;
+    string playoutPath; // notation of the move being enumerated
+    vector<Path> playoutLog; // edges drawn by the playout so far
+    vector<vector<int>> playoutNeighbours; // free neighbours, one buffer per bounce
+    vector<uint8_t> onPath;
+    vector<uint64_t> playoutCycles;
+    vector<uint64_t> playoutBlocked;
+
     float simulateOne(int forPlayer) {
         player_t currentPlayer = forPlayer == ONE ? TWO : ONE;
-        vector<vector<Path>> paths;
+        int start = game->pitch.ball;
+        playoutLog.clear();
+        float result;
         while (true) {
-            vector<ShortMove *> moves = getMovesForSimulation(currentPlayer, limitPlayouts);
-            sort(moves.begin(), moves.end(), [](ShortMove *a, ShortMove *b) -> bool { return a->score > b->score; });
-            if (abs(moves[0]->score) > TERMINAL_THRESHOLD) {
-                int score = moves[0]->score;
-                while (!paths.empty()) {
-                    vector<Path> p = paths.back();
-                    paths.pop_back();
-                    undoMove(p);
-                }
-                for (auto m : moves) {
-                    delete m;
-                }
-                return score > TERMINAL_THRESHOLD ? (currentPlayer == forPlayer ? 1 : 0) : (currentPlayer == forPlayer ? 0 : 1);
-            }
-
+            getMovesForSimulation(currentPlayer, limitPlayouts);
+            // the best score and how many moves do not lose, instead of sorting
+            float best = -2 * INF;
             int n = 0;
-            for (auto & m : moves) {
-                if (m->score < -TERMINAL_THRESHOLD) break;
-                n++;
+            for (auto & m : playoutMoves) {
+                best = max(best, m.score);
+                if (m.score >= -TERMINAL_THRESHOLD) n++;
+            }
+            if (playoutMoves.empty() || abs(best) > TERMINAL_THRESHOLD) {
+                result = best > TERMINAL_THRESHOLD ? (currentPlayer == forPlayer ? 1 : 0) : (currentPlayer == forPlayer ? 0 : 1);
+                break;
             }
 
-            auto & move = moves[ran.nextInt(n)];
-
-            vector<Path> p = makeMove(move->move);
-            paths.push_back(p);
-
-            for (auto m : moves) {
-                delete m;
+            int pick = ran.nextInt(n);
+            for (auto & m : playoutMoves) {
+                if (m.score < -TERMINAL_THRESHOLD) continue;
+                if (pick-- > 0) continue;
+                for (int c = m.start; c < m.start + m.length; c++) {
+                    int next = nextNode(playoutChars[c]);
+                    playoutLog.push_back(Path(game->pitch.ball, next));
+                    game->pitch.addEdge(game->pitch.ball, next);
+                    game->pitch.ball = next;
+                }
+                break;
             }
 
             currentPlayer = currentPlayer == ONE ? TWO : ONE;
         }
 
-        return 0;
+        for (int i = (int)playoutLog.size() - 1; i >= 0; i--) {
+            game->pitch.removeEdge(playoutLog[i].a, playoutLog[i].b);
+        }
+        game->pitch.ball = start;
+        return result;
     }
 
-    vector<ShortMove *> getMovesForSimulation(player_t player, int limit) {
-        vector<ShortMove*> moves; moves.reserve(limit);
-        deque<pair<int, vector<Path>>> talia;
-        vector<int> vertices; vertices.reserve(25);
-        vector<uint64_t> pathCycles; pathCycles.reserve(25);
-        vector<int> blockedMoves; blockedMoves.reserve(25);
-        string str = "";
-        vector<int> ns(8);
-
-        vertices.push_back(game->pitch.ball);
-        talia.push_back(make_pair(game->pitch.ball, vector<Path>()));
-
+    // Fills playoutMoves with up to limit moves, stops early at a winning one. Same moves and
+    // scores as generateMoves, enumerated depth first with the edges drawn in place.
+    void getMovesForSimulation(player_t player, int limit) {
+        playoutMoves.clear();
+        playoutChars.clear();
+        playoutPath.clear();
+        playoutCycles.clear();
+        playoutBlocked.clear();
+        if (onPath.size() != (size_t)game->pitch.size) onPath.assign(game->pitch.size, 0);
+
+        int start = game->pitch.ball;
         vector<int> konceEdges;
         bool check = true;
         if (!game->pitch.onlyOneEmpty()) {
@@ -431,111 +474,98 @@ public:
         bool alreadyBlocking = player == this->player ? this->alreadyBlocking : this->alreadyBlocked;
         bool alreadyBlocked = player == this->player ? this->alreadyBlocked : this->alreadyBlocking;
 
-        int loop = 0;
+        onPath[start]++;
+        collectPlayoutMoves(start, 0, player, limit, check, alreadyBlocking, alreadyBlocked, 0);
+        onPath[start]--;
+        game->pitch.ball = start;
 
-        while (!talia.empty() && moves.size() < limit) {
-            pair<int, vector<Path>> v_paths;
-            loop++;
-            if ((loop & 15) == 0) {
-                v_paths = talia.front();
-                talia.pop_front();
-            } else {
-                v_paths = talia.back();
-                talia.pop_back();
-            }
-            int t = v_paths.first;
-            vector<Path> &paths = v_paths.second;
-            for (auto &p : paths) {
-                str += game->pitch.getDistanceChar(p.a, p.b);
-                game->pitch.addEdge(p.a, p.b);
-                vertices.push_back(p.b);
+        for (int i = 0; i < (int)konceEdges.size() / 2; i++) {
+            game->pitch.removeEdge(konceEdges[2 * i], konceEdges[2 * i + 1]);
+        }
+    }
+
+    // true when enough moves were found
+    bool collectPlayoutMoves(int t, int depth, player_t player, int limit, bool check, bool alreadyBlocking, bool alreadyBlocked, uint64_t pathHash) {
+        if ((int)playoutNeighbours.size() <= depth) {
+            playoutNeighbours.emplace_back();
+            playoutNeighbours.back().reserve(8);
+        }
+        game->pitch.ball = t;
+        game->pitch.fillFreeNeighbours(playoutNeighbours[depth], t);
+        shuffle(playoutNeighbours[depth]);
+
+        // by index, deeper calls may move the buffers
+        for (size_t i = 0; i < playoutNeighbours[depth].size(); i++) {
+            int n = playoutNeighbours[depth][i];
+            uint64_t hash = pathHash + hashPath(Path(t, n));
+            if (!game->pitch.isAlmostBlocked(n) && game->pitch.passNext(n)) {
+                if (onPath[n] > 0) {
+                    if (find(playoutCycles.begin(), playoutCycles.end(), hash) != playoutCycles.end()) continue;
+                    playoutCycles.push_back(hash);
+                }
+                game->pitch.addEdge(t, n);
+                onPath[n]++;
+                playoutPath += game->pitch.getDistanceChar(t, n);
+                bool done = collectPlayoutMoves(n, depth+1, player, limit, check, alreadyBlocking, alreadyBlocked, hash);
+                playoutPath.pop_back();
+                onPath[n]--;
+                game->pitch.removeEdge(t, n);
+                game->pitch.ball = t;
+                if (done) return true;
+                continue;
             }
-            game->pitch.ball = t;
-            game->pitch.fillFreeNeighbours(ns, t);
-            shuffle(ns);
 
-            for (auto & n : ns) {
-                if (!game->pitch.isAlmostBlocked(n) && game->pitch.passNext(n)) {
-                    vector<Path> newPaths(paths);
-                    newPaths.push_back(Path(t, n));
-                    if (find(vertices.begin(), vertices.end(), n) != vertices.end()) {
-                        int newPathsHash = hashPaths(newPaths);
-                        if (find(pathCycles.begin(), pathCycles.end(), newPathsHash) == pathCycles.end()) {
-                            pathCycles.push_back(newPathsHash);
-                            talia.push_back(make_pair(n, newPaths));
-                        }
-                    } else
-                        talia.push_back(make_pair(n, newPaths));
-                } else {
-                    player_t goal = game->pitch.goal(n);
-                    game->pitch.addEdge(t, n);
-                    game->pitch.ball = n;
+            player_t goal = game->pitch.goal(n);
+            game->pitch.addEdge(t, n);
+            game->pitch.ball = n;
 
-                    float score = 0;
-                    if (goal != NONE) {
-                        if (goal == player) {
-                            score = MIN_GOAL + game->rounds;
-                        } else {
-                            score = MAX_GOAL - game->rounds;
-                        }
-                    } else {
-                        if (game->pitch.isBlocked(n)) {
-                            vector<Path> newPaths(paths);
-                            newPaths.push_back(Path(t, n));
-                            int newPathsHash = hashPaths(newPaths);
-                            if (find(blockedMoves.begin(), blockedMoves.end(), newPathsHash) != blockedMoves.end()) {
-                                game->pitch.ball = t;
-                                game->pitch.removeEdge(t, n);
-                                continue;
-                            }
-                            blockedMoves.push_back(newPathsHash);
-                            score = MIN_BLOCKED + game->rounds;
-                        } else {
-                            if (check && game->pitch.isGoalReachable(player)) {
-                                score = MIN_GOAL_NEXT_MOVE + game->rounds;
-                            } else if (game->pitch.onlyOneEmpty()) {
-                                score = MAX_ONE_EMPTY - game->rounds;
-                            } else if (game->pitch.onlyTwoEmpty()) {
-                                score = MIN_GOAL_ONE_EMPTY + game->rounds;
-                            } else if (!alreadyBlocked && game->pitch.passNextDone2(t) && game->pitch.isCutOffFromOpponentGoal(player)) {
-                                score = MIN_CUTOFF + game->rounds;
-                            } else if (!alreadyBlocking && game->pitch.passNextDone2(t) && game->pitch.isCutOffFromOpponentGoal(player == ONE ? TWO : ONE)) {
-                                score = MAX_CUTOFF - game->rounds;
-                            } else {
-                                if (kupa) {
-                                    score = -getScoreQuick(player == ONE ? TWO : ONE, LIMIT_MOVES_PLAYOUT);
-                                }
-                            }
-                        }
+            float score = 0;
+            if (goal != NONE) {
+                if (goal == player) {
+                    score = MIN_GOAL + game->rounds;
+                } else {
+                    score = MAX_GOAL - game->rounds;
+                }
+            } else {
+                if (game->pitch.isBlocked(n)) {
+                    if (find(playoutBlocked.begin(), playoutBlocked.end(), hash) != playoutBlocked.end()) {
+                        game->pitch.ball = t;
+                        game->pitch.removeEdge(t, n);
+                        continue;
                     }
-                    game->pitch.ball = t;
-                    game->pitch.removeEdge(t, n);
-                    str += game->pitch.getDistanceChar(t, n);
-                    ShortMove *move = new ShortMove(score,str);
-                    moves.push_back(move);
-                    if (score > TERMINAL_THRESHOLD) {
-                        for (int i = 0; i < konceEdges.size() / 2; i++) {
-                            game->pitch.removeEdge(konceEdges[2 * i], konceEdges[2 * i + 1]);
+                    playoutBlocked.push_back(hash);
+                    score = MIN_BLOCKED + game->rounds;
+                } else {
+                    if (check && game->pitch.isGoalReachable(player)) {
+                        score = MIN_GOAL_NEXT_MOVE + game->rounds;
+                    } else if (game->pitch.onlyOneEmpty()) {
+                        score = MAX_ONE_EMPTY - game->rounds;
+                    } else if (game->pitch.onlyTwoEmpty()) {
+                        score = MIN_GOAL_ONE_EMPTY + game->rounds;
+                    } else if (!alreadyBlocked && game->pitch.passNextDone2(t) && game->pitch.isCutOffFromOpponentGoal(player)) {
+                        score = MIN_CUTOFF + game->rounds;
+                    } else if (!alreadyBlocking && game->pitch.passNextDone2(t) && game->pitch.isCutOffFromOpponentGoal(player == ONE ? TWO : ONE)) {
+                        score = MAX_CUTOFF - game->rounds;
+                    } else {
+                        if (kupa) {
+                            score = -getScoreQuick(player == ONE ? TWO : ONE, LIMIT_MOVES_PLAYOUT);
                         }
-                        for (auto &p : paths) game->pitch.removeEdge(p.a, p.b);
-                        game->pitch.ball = vertices[0];
-                        return moves;
                     }
-                    str.pop_back();
-                    if (moves.size() >= limit) break;
                 }
             }
-            vertices.erase(vertices.begin() + 1, vertices.end());
-            str.clear();
-            for (auto &p : paths) game->pitch.removeEdge(p.a, p.b);
-            game->pitch.ball = vertices[0];
-        }
-
-        for (int i = 0; i < konceEdges.size() / 2; i++) {
-            game->pitch.removeEdge(konceEdges[2 * i], konceEdges[2 * i + 1]);
+            game->pitch.ball = t;
+            game->pitch.removeEdge(t, n);
+
+            PlayoutMove move;
+            move.score = score;
+            move.start = playoutChars.size();
+            move.length = playoutPath.size() + 1;
+            playoutChars += playoutPath;
+            playoutChars += game->pitch.getDistanceChar(t, n);
+            playoutMoves.push_back(move);
+            if (score > TERMINAL_THRESHOLD || (int)playoutMoves.size() >= limit) return true;
         }
-
-        return moves;
+        return false;
     }
 
     vector<Path> makeMove(string &move) {
@@ -683,22 +713,30 @@ public:
 
 };
 
+// Shared mode: all threads grow one tree, nodes are locked. Root parallel mode: every thread
+// grows its own tree from a copy of the root moves without locks, and every MCTS_MERGE_PLAYOUTS
+// playouts adds what its root moves gained to the common root statistics and takes them back,
+// so the threads keep choosing among the root moves with everything learnt so far.
 class MctsCpu : public MctsCpuWorker {
 public:
+    int games;
+
     MctsCpu(int limit = LIMIT_MOVES, int limitPlayouts = LIMIT_MOVES_PLAYOUT) : MctsCpuWorker(limit,limitPlayouts) {
         numThreads = 1;
+        pool = &movePool;
     }
 
     void work(vector<MctsMove*> &moves, mutex &globalLock) {
         MctsCpuWorker cpuWorker(limit, limitPlayouts);
         cpuWorker.provenEnd = false;
         cpuWorker.kupa = kupa;
+        cpuWorker.pool = pool;
         Game *copy = new Game();
         copy->setGame(game);
         cpuWorker.setGame(copy);
 
-        auto duration = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
-        while (duration < timeInMicro && !cpuWorker.provenEnd) {
+        uint64_t duration = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        while (duration < timeInMicro && !cpuWorker.provenEnd && !stopToken->stopped()) {
             cpuWorker.selectAndExpand(moves, games + 1, 0);
             globalLock.lock();
             games++;
@@ -709,8 +747,77 @@ public:
         cpuWorker.deleteGame();
     }
 
+    void workRoot(int th, vector<MctsMove*> &moves, mutex &globalLock) {
+        MctsMovePool &threadPool = *threadPools[th];
+        threadPool.clear();
+        threadPool.locking = false;
+        MctsCpuWorker cpuWorker(limit, limitPlayouts);
+        cpuWorker.provenEnd = false;
+        cpuWorker.kupa = kupa;
+        cpuWorker.pool = &threadPool;
+        cpuWorker.shared = false;
+        Game *copy = new Game();
+        copy->setGame(game);
+        cpuWorker.setGame(copy);
+
+        vector<MctsMove*> roots;
+        globalLock.lock(); // other threads may be merging already
+        for (auto &m : moves) {
+            MctsMove *root = threadPool.create(m->move, m->player, nullptr);
+            root->score = m->score;
+            root->games = m->games;
+            root->terminal = m->terminal;
+            root->heuristic = m->heuristic;
+            roots.push_back(root);
+        }
+        // root statistics as they were after the last merge
+        vector<float> mergedScores(moves.size());
+        vector<int> mergedGames(moves.size());
+        for (size_t i=0; i < moves.size(); i++) {
+            mergedScores[i] = roots[i]->score;
+            mergedGames[i] = roots[i]->games;
+        }
+        int total = games;
+        globalLock.unlock();
+
+        int playouts = 0;
+        uint64_t duration = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        while (true) {
+            bool done = duration >= timeInMicro || cpuWorker.provenEnd || stopToken->stopped();
+            if (done || playouts == MCTS_MERGE_PLAYOUTS) {
+                globalLock.lock();
+                for (size_t i=0; i < moves.size(); i++) {
+                    MctsMove *root = roots[i], *m = moves[i];
+                    if (root->terminal && !m->terminal) {
+                        m->terminal = true;
+                        m->score = root->score;
+                        m->games = max(m->games, 1);
+                    } else if (!m->terminal) {
+                        m->score += root->score - mergedScores[i];
+                        m->games += root->games - mergedGames[i];
+                    }
+                    root->score = mergedScores[i] = m->score;
+                    root->games = mergedGames[i] = m->games;
+                    root->terminal = m->terminal;
+                }
+                games += playouts;
+                total = games;
+                globalLock.unlock();
+                playouts = 0;
+                if (done) break;
+            }
+            cpuWorker.selectAndExpand(roots, total + playouts + 1, 0);
+            playouts++;
+            duration = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+        }
+
+        cpuWorker.deleteGame();
+    }
+
+    // the move belongs to the cpu, valid until the next search
     MctsMove* getBestMove(uint64_t timeInMicro) {
         start = high_resolution_clock::now();
+        movePool.clear();
         this->timeInMicro = timeInMicro;
         alreadyBlocking = game->pitch.isCutOffFromOpponentGoal(player == ONE ? TWO : ONE);
         alreadyBlocked = game->pitch.isCutOffFromOpponentGoal(player);
@@ -721,8 +828,10 @@ public:
         provenEnd = false;
         vector<thread> threads;
         mutex globalLock;
+        while (rootParallel && (int)threadPools.size() < numThreads) threadPools.emplace_back(new MctsMovePool());
         for (int i = 0; i < numThreads; i++) {
-            threads.push_back(thread(&MctsCpu::work, this, ref(moves), ref(globalLock)));
+            if (rootParallel) threads.push_back(thread(&MctsCpu::workRoot, this, i, ref(moves), ref(globalLock)));
+            else threads.push_back(thread(&MctsCpu::work, this, ref(moves), ref(globalLock)));
         }
         for (auto &t : threads) t.join();
 
@@ -742,10 +851,6 @@ public:
             return A < B;
         });
 
-        for (int i=1; i < moves.size(); i++) {
-            delete moves[i];
-        }
-
         return moves[0];
     }
 
@@ -753,9 +858,16 @@ public:
         numThreads = n;
     }
 
+    // root parallel instead of one shared tree
+    void setRootParallel(bool rootParallel) {
+        this->rootParallel = rootParallel;
+    }
+
 private:
     int numThreads;
-    int games;
+    bool rootParallel = false;
+    MctsMovePool movePool;
+    vector<unique_ptr<MctsMovePool>> threadPools; // root parallel, one per thread
 
     high_resolution_clock::time_point start;
     uint64_t timeInMicro;
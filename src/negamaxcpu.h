@@ -3,13 +3,18 @@
 
 #define MAX_GOAL 1000
 #define MAX_ONE_EMPTY 850
+#define MAX_SOLVED 820
 #define MAX_CUTOFF 800
 #define MIN_CUTOFF -800
+#define MIN_SOLVED -820
 #define MIN_GOAL_ONE_EMPTY -850
 #define MIN_GOAL_NEXT_MOVE -900
 #define MIN_GOAL -950
 #define MIN_BLOCKED -1000
 #define TERMINAL_THRESHOLD 500
+#define PVS_WINDOW 0.001f // null window width, evaluations are floats
+#define ASPIRATION_WINDOW 0.05f // first half width around the previous iteration's score
+#define MAX_PLY 64
 
 #define LIMIT_MOVES 100
 
@@ -17,6 +22,8 @@
 #include <chrono>
 #include <vector>
 #include <deque>
+#include <thread>
+#include <climits>
 
 #include "cpu.h"
 #include "pitch.h"
@@ -48,11 +55,18 @@ public:
 
     }
 
+    virtual ~Evaluator() { }
+
     virtual float evaluate(Game *game, player_t player) {
         int n = game->pitch.ball;
         int score = player == ONE ? game->pitch.getPosition(n).y : 10 - game->pitch.getPosition(n).y;
         return score;
     }
+
+    // for another search thread
+    virtual Evaluator* clone() {
+        return new Evaluator();
+    }
 };
 
 class NoEvaluator : public Evaluator {
@@ -64,6 +78,10 @@ public:
     float evaluate(Game *game, player_t player) override {
         return 0;
     }
+
+    Evaluator* clone() override {
+        return new NoEvaluator();
+    }
 };
 
 class BackerEvaluator : public Evaluator {
@@ -78,6 +96,10 @@ public:
         //        int score = game->pitch.getDistancesToGoal(player);
         return score;
     }
+
+    Evaluator* clone() override {
+        return new BackerEvaluator();
+    }
 };
 
 class SmartDistanceEvaluator : public Evaluator {
@@ -90,6 +112,10 @@ public:
         int score = game->pitch.getDistancesToGoal(player);
         return score;
     }
+
+    Evaluator* clone() override {
+        return new SmartDistanceEvaluator();
+    }
 };
 
 class SmartBackerDistanceEvaluator : public Evaluator {
@@ -102,23 +128,42 @@ public:
         int score = -game->pitch.getDistancesToGoal(player);
         return score;
     }
+
+    Evaluator* clone() override {
+        return new SmartBackerDistanceEvaluator();
+    }
 };
 
 class NetworkEvaluator : public Evaluator {
 public:
-    Network *agent;
+    INetwork *agent;
+    EvalContext context;
     Random ran;
 
-    NetworkEvaluator(Network *agent) : Evaluator(), agent(agent) {
+    NetworkEvaluator(INetwork *agent) : Evaluator(), agent(agent) {
 
     }
 
     float evaluate(Game *game, player_t player) override {
-        auto tuples = game->getTuplesEdges3();
-        float score = agent->getScore(tuples);
+        uint64_t key = game->pitch.getKey(game->currentPlayer);
+        float score;
+        bool hit = agent->cache != nullptr && agent->cache->probe(key, score);
+        if (!hit) {
+            auto tuples = agent->type == 0 ? game->getTuplesEdges() : agent->type == 1 ? game->getTuplesEdges3() : game->getTuplesEdges4();
+            score = agent->getScore(tuples, context);
+        }
+        if (agent->cache != nullptr) {
+            if (!hit) agent->cache->store(key, score);
+            agent->cache->addStats(1, hit ? 1 : 0);
+        }
         score = 0.95f * score + 0.05f * ran.nextFloat(-1,1);
         return player == game->currentPlayer ? score : -score;
     }
+
+    // own context and random, same network
+    Evaluator* clone() override {
+        return new NetworkEvaluator(agent);
+    }
 };
 
 class NegamaxCpu : public ICpu {
@@ -127,10 +172,70 @@ public:
 
     }
 
+    virtual ~NegamaxCpu() {
+        if (ownsTable) delete table;
+    }
+
+    // Lazy SMP: threads-1 helpers run the same iterative deepening on copies of the game, every
+    // other one a level ahead and all with their own random move order. They only share the
+    // transposition table, the result is the one of the calling thread.
+    void setThreads(int threads, size_t tableMegabytes = 16) {
+        this->threads = max(1, threads);
+        if (table == nullptr) {
+            table = new TranspositionTable(tableMegabytes);
+            ownsTable = true;
+        }
+    }
+
     NegamaxMove getBestMove(uint64_t timeInMicro, int levels = 50) {
         start = high_resolution_clock::now();
         measureTime = true;
         this->timeInMicro = timeInMicro;
+        if (table != nullptr) table->clear();
+
+        helpersStop.reset();
+        vector<thread> helpers;
+        for (int i=1; i < threads; i++) {
+            helpers.push_back(thread(&NegamaxCpu::help, this, i, levels, *game));
+        }
+        NegamaxMove bestMove = iterate(levels, 1);
+        helpersStop.stop();
+        for (auto & t : helpers) t.join();
+        return bestMove;
+    }
+
+private:
+    Evaluator* evaluator;
+    int limit;
+    bool measureTime;
+    high_resolution_clock::time_point start;
+    uint64_t timeInMicro;
+    bool alreadyBlocking;
+    bool alreadyBlocked;
+    int threads = 1;
+    TranspositionTable *table = nullptr;
+    bool ownsTable = false;
+    StopToken helpersStop;
+    vector<int> historyNodes;
+    vector<int> historyEdges;
+    vector<uint64_t> killers; // two per ply from the root
+
+    // the game is copied before the calling thread starts changing it
+    void help(int id, int levels, Game copy) {
+        NegamaxCpu helper(evaluator->clone(), limit);
+        helper.setGame(&copy);
+        helper.setPlayer(player);
+        helper.stopToken = &helpersStop;
+        helper.table = table;
+        helper.start = start;
+        helper.measureTime = true;
+        helper.timeInMicro = timeInMicro;
+        helper.iterate(levels, 1 + (id & 1));
+        delete helper.evaluator;
+    }
+
+    NegamaxMove iterate(int levels, int firstLevel) {
+        prepareOrdering();
         alreadyBlocking = game->pitch.isCutOffFromOpponentGoal(player == ONE ? TWO : ONE);
         alreadyBlocked = game->pitch.isCutOffFromOpponentGoal(player);
 
@@ -141,27 +246,51 @@ public:
             return bestMove;
         }
 
-        for (int i=1; i < levels; i++) {
-            for (auto & move : moves) {
-                if (move.score < -TERMINAL_THRESHOLD) {
-                    continue;
-                }
-                auto paths = makeMove(move.move);
-                game->changePlayer();
-                game->rounds++;
-                try {
-                    move.score = -getScore(i,-1, i-1, -INF, INF);
-                } catch (int e) {
+        for (int i=firstLevel; i < levels; i++) {
+            // aspiration window around the last score, widened four times on each fail
+            float previous = bestMove.score;
+            float delta = ASPIRATION_WINDOW;
+            bool full = abs(previous) > TERMINAL_THRESHOLD;
+            float low = full ? -INF : previous - delta;
+            float high = full ? INF : previous + delta;
+            while (true) {
+                float alpha = low;
+                bool first = true;
+                for (auto & move : moves) {
+                    if (move.score < -TERMINAL_THRESHOLD) {
+                        continue;
+                    }
+                    auto paths = makeMove(move.move);
+                    game->changePlayer();
+                    game->rounds++;
+                    try {
+                        move.score = searchChild(i, -1, i-1, alpha, high, first);
+                    } catch (int e) {
+                        game->rounds--;
+                        game->changePlayer();
+                        undoMove(paths);
+                        return bestMove;
+                    }
                     game->rounds--;
                     game->changePlayer();
                     undoMove(paths);
-                    return bestMove;
+                    // a move that only failed the null window ranks below the one that set alpha
+                    if (!first && move.score <= alpha) move.score = min(move.score, alpha - PVS_WINDOW);
+                    first = false;
+                    if (move.score > bestMove.score) {
+                        bestMove = move;
+                    }
+                    alpha = max(alpha, move.score);
+                    if (alpha >= high) break;
                 }
-                game->rounds--;
-                game->changePlayer();
-                undoMove(paths);
-                if (move.score > bestMove.score) {
-                    bestMove = move;
+                if (alpha <= low && low > -INF) {
+                    delta *= 4;
+                    low = delta > TERMINAL_THRESHOLD ? -INF : previous - delta;
+                } else if (alpha >= high && high < INF) {
+                    delta *= 4;
+                    high = delta > TERMINAL_THRESHOLD ? INF : previous + delta;
+                } else {
+                    break;
                 }
             }
             bestMove = getBestMoveSoFar(moves);
@@ -173,14 +302,62 @@ public:
         return bestMove;
     }
 
-private:
-    Evaluator* evaluator;
-    int limit;
-    bool measureTime;
-    high_resolution_clock::time_point start;
-    uint64_t timeInMicro;
-    bool alreadyBlocking;
-    bool alreadyBlocked;
+    // Principal variation search: the first move gets the whole window, the others a null window
+    // around alpha, searched again with the whole window only when they beat it. Called with the
+    // move made, returns the score for the side that made it.
+    float searchChild(int levels, int color, int level, float alpha, float beta, bool first) {
+        if (first) return -getScore(levels, color, level, -beta, -alpha);
+        float score = -getScore(levels, color, level, -alpha-PVS_WINDOW, -alpha);
+        if (score > alpha && score < beta) {
+            score = -getScore(levels, color, level, -beta, -alpha);
+        }
+        return score;
+    }
+
+    // Killer moves (the last two that caused a cutoff at the same ply, by hashPaths) first, then
+    // by history of the ball's final node and of the last edge drawn. Ties keep the random order
+    // of the generation.
+    void orderMoves(vector<vector<Path>> & moves, int ply) {
+        if (moves.size() < 2) return;
+        ply = min(ply, MAX_PLY-1);
+        vector<pair<int,int>> order; order.reserve(moves.size());
+        for (size_t i=0; i < moves.size(); i++) {
+            auto & last = moves[i].back();
+            uint64_t hash = hashPaths(moves[i]);
+            int score = historyNodes[last.b] + historyEdges[last.a * game->pitch.size + last.b];
+            if (hash == killers[2*ply]) score = INT_MAX;
+            else if (hash == killers[2*ply+1]) score = INT_MAX - 1;
+            order.push_back(make_pair(score, (int)i));
+        }
+        stable_sort(order.begin(), order.end(), [](const pair<int,int> & a, const pair<int,int> & b) { return a.first > b.first; });
+        vector<vector<Path>> ordered; ordered.reserve(moves.size());
+        for (auto & o : order) ordered.push_back(move(moves[o.second]));
+        moves.swap(ordered);
+    }
+
+    void rememberCutoff(vector<Path> & move, int ply, int level) {
+        ply = min(ply, MAX_PLY-1);
+        auto & last = move.back();
+        historyNodes[last.b] += level * level;
+        historyEdges[last.a * game->pitch.size + last.b] += level * level;
+        uint64_t hash = hashPaths(move);
+        if (killers[2*ply] != hash) {
+            killers[2*ply+1] = killers[2*ply];
+            killers[2*ply] = hash;
+        }
+    }
+
+    // history is kept between searches at half weight, killers are not
+    void prepareOrdering() {
+        size_t nodes = game->pitch.size;
+        if (historyNodes.size() != nodes) {
+            historyNodes.assign(nodes, 0);
+            historyEdges.assign(nodes * nodes, 0);
+        }
+        for (auto & h : historyNodes) h /= 2;
+        for (auto & h : historyEdges) h /= 2;
+        killers.assign(2 * MAX_PLY, 0);
+    }
 
     NegamaxMove getBestMoveSoFar(vector<NegamaxMove> & moves) {
         sort(moves.rbegin(), moves.rend());
@@ -318,6 +495,7 @@ private:
     }
 
     float getScore(int levels, int color, int level, float alpha, float beta) {
+        if (stopToken->stopped()) throw -1;
         if (measureTime) {
             high_resolution_clock::time_point stop = high_resolution_clock::now();
             if (duration_cast<microseconds>(stop - start).count() >= timeInMicro) {
@@ -327,6 +505,18 @@ private:
 
         player_t player = color == 1 ? this->player : (this->player == ONE ? TWO : ONE);
 
+        uint64_t key = 0;
+        float alphaStart = alpha;
+        if (table != nullptr) {
+            key = game->pitch.getKey(player);
+            TTEntry entry;
+            if (table->probe(key, entry) && entry.depth >= level) {
+                if (entry.flag == TT_EXACT) return entry.value;
+                if (entry.flag == TT_LOWER_BOUND && entry.value >= beta) return entry.value;
+                if (entry.flag == TT_UPPER_BOUND && entry.value <= alpha) return entry.value;
+            }
+        }
+
         deque<pair<int, vector<Path>>> talia;
         vector<int> vertices; vertices.reserve(25);
         vector<uint64_t> pathCycles; pathCycles.reserve(25);
@@ -350,6 +540,7 @@ private:
         int loop = 0;
 
         float output = -INF;
+        vector<vector<Path>> candidates;
 
         int count = 0;
         while (!talia.empty() && count < limit) {
@@ -422,23 +613,15 @@ private:
                                 score = MAX_CUTOFF - game->rounds;
                             } else {
                                 if (level > 0) {
-                                    game->changePlayer();
-                                    game->rounds++;
-                                    try {
-                                        score = -getScore(levels,-color, level-1, -beta, -alpha);
-                                    } catch (int e) {
-                                        game->rounds--;
-                                        for (int i = 0; i < konceEdges.size() / 2; i++) {
-                                            game->pitch.removeEdge(konceEdges[2 * i], konceEdges[2 * i + 1]);
-                                        }
-                                        game->changePlayer();
-                                        game->pitch.removeEdge(t, n);
-                                        for (auto &p : paths) game->pitch.removeEdge(p.a, p.b);
-                                        game->pitch.ball = vertices[0];
-                                        throw e;
-                                    }
-                                    game->changePlayer();
-                                    game->rounds--;
+                                    // searched below, once all the moves are known and ordered
+                                    vector<Path> move(paths);
+                                    move.push_back(Path(t, n));
+                                    candidates.push_back(move);
+                                    game->pitch.ball = t;
+                                    game->pitch.removeEdge(t, n);
+                                    count++;
+                                    if (count >= limit) break;
+                                    continue;
                                 } else {
                                     game->changePlayer();
                                     score = color * evaluator->evaluate(game, this->player);
@@ -459,6 +642,7 @@ private:
                         }
                         for (auto &p : paths) game->pitch.removeEdge(p.a, p.b);
                         game->pitch.ball = vertices[0];
+                        if (table != nullptr) table->store(key, output, level, TT_LOWER_BOUND);
                         return output;
                     }
                     count++;
@@ -470,6 +654,42 @@ private:
             game->pitch.ball = vertices[0];
         }
 
+        orderMoves(candidates, levels - level);
+        for (size_t c = 0; c < candidates.size(); c++) {
+            auto & move = candidates[c];
+            for (auto &p : move) game->pitch.addEdge(p.a, p.b);
+            game->pitch.ball = move.back().b;
+            game->changePlayer();
+            game->rounds++;
+            float score;
+            try {
+                score = searchChild(levels, -color, level-1, alpha, beta, c == 0);
+            } catch (int e) {
+                game->rounds--;
+                game->changePlayer();
+                for (auto &p : move) game->pitch.removeEdge(p.a, p.b);
+                game->pitch.ball = vertices[0];
+                for (int i = 0; i < (int)konceEdges.size() / 2; i++) {
+                    game->pitch.removeEdge(konceEdges[2 * i], konceEdges[2 * i + 1]);
+                }
+                throw e;
+            }
+            game->rounds--;
+            game->changePlayer();
+            for (auto &p : move) game->pitch.removeEdge(p.a, p.b);
+            game->pitch.ball = vertices[0];
+            output = max(score, output);
+            alpha = max(output, alpha);
+            if (alpha >= beta) {
+                rememberCutoff(move, levels - level, level);
+                for (int i = 0; i < (int)konceEdges.size() / 2; i++) {
+                    game->pitch.removeEdge(konceEdges[2 * i], konceEdges[2 * i + 1]);
+                }
+                if (table != nullptr) table->store(key, output, level, TT_LOWER_BOUND);
+                return output;
+            }
+        }
+
         for (int i = 0; i < konceEdges.size() / 2; i++) {
             game->pitch.removeEdge(konceEdges[2 * i], konceEdges[2 * i + 1]);
         }
@@ -477,6 +697,7 @@ private:
         if (output == -INF) {
             output = MIN_GOAL_ONE_EMPTY - game->rounds;
         }
+        if (table != nullptr) table->store(key, output, level, output <= alphaStart ? TT_UPPER_BOUND : TT_EXACT);
         return output;
     }
 };
@@ -2,13 +2,23 @@
 #define NETWORK_H
 
 #include <cmath>
+#include <algorithm>
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cstring>
 #include <cstdlib>
+#include <cstdint>
 #include "random.h"
+#include "evalcache.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 using namespace std;
 
@@ -85,10 +95,8 @@ struct QNetwork {
         ifstream plik;
         plik.open(name);
         const int size = inputs * hidden + hidden * outputs;
-        char result[1<<20];
-        plik.read(result, sizeof(float) * size);
         vector<float> solution(size);
-        memcpy(&solution[0], result, sizeof(float) * size);
+        plik.read((char*)solution.data(), sizeof(float) * size);
         fromVector(solution);
         plik.close();
     }
@@ -97,16 +105,8 @@ struct QNetwork {
         string name1 = std::to_string(hidden)+"_"+name;
         cout << "save " << name1 << endl;
         ofstream plik; plik.open(name1, ios::out | ios::binary);
-        {
-            char result[sizeof(float) * inputs * hidden];
-            memcpy(result, &hiddenWeights[0], sizeof(float) * inputs * hidden);
-            plik.write(result, sizeof(float) * inputs * hidden);
-        }
-        {
-            char result[sizeof(float) * outputs * hidden];
-            memcpy(result, &outputWeights[0], sizeof(float) * outputs * hidden);
-            plik.write(result, sizeof(float) * outputs * hidden);
-        }
+        plik.write((const char*)hiddenWeights.data(), sizeof(float) * inputs * hidden);
+        plik.write((const char*)outputWeights.data(), sizeof(float) * outputs * hidden);
         plik.close();
     }
 
@@ -237,10 +237,295 @@ struct QNetwork {
 };
 
 
-class Network {
+// Weight file: 64 byte header, then the weight arrays of the architecture in order
+// (Network: hidden, output; NetworkDeep: hidden, hidden2, output), as floats or as int16
+// multiplied by scale. Files without the header are the old raw float dumps.
+#define WEIGHTS_MAGIC "PSWEIGHT"
+#define WEIGHTS_VERSION 1
+#define NET_PLAIN 0
+#define NET_SCRELU 1
+#define NET_DEEP 2
+#define QUANT_FLOAT 0
+#define QUANT_INT16 1
+
+struct WeightHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t architecture;
+    uint32_t inputType;
+    uint32_t inputs;
+    uint32_t hidden;
+    uint32_t hidden2;
+    uint32_t quantization;
+    float scale;
+    uint32_t checksum;
+    uint32_t reserved1;
+    uint64_t payloadSize;
+    char reserved[8];
+};
+
+static_assert(sizeof(WeightHeader) == 64, "WeightHeader must be 64 bytes");
+
+// first layer size the engines index for an input type (agent->type), 0 if it's unknown.
+// Type 0 uses a copy of the inputs per player to move, the ball square ends every layout.
+inline uint32_t inputTypeSize(uint32_t inputType) {
+    if (inputType == 0) return 830;
+    if (inputType == 1) return 435;
+    if (inputType == 2) return 1466;
+    return 0;
+}
+
+// Read-only mapping of a weight file. Processes loading the same file share its pages.
+class WeightFile {
+public:
+    WeightHeader header;
+
+    WeightFile() {}
+
+    virtual ~WeightFile() {
+#ifndef _WIN32
+        if (mapped != nullptr) munmap(mapped, mappedSize);
+#endif
+    }
+
+    WeightFile(const WeightFile &) = delete;
+    WeightFile & operator=(const WeightFile &) = delete;
+
+    static bool hasHeader(const string & fileName) {
+        char magic[8] = {0};
+        ifstream plik(fileName, ios::binary);
+        plik.read(magic, 8);
+        return plik.gcount() == 8 && memcmp(magic, WEIGHTS_MAGIC, 8) == 0;
+    }
+
+    // maps the file and checks header, size and checksum, prints the reason on failure
+    bool open(const string & fileName) {
+#ifndef _WIN32
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) return fail(fileName, "cannot open");
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(WeightHeader)) {
+            ::close(fd);
+            return fail(fileName, "too short");
+        }
+        mappedSize = st.st_size;
+        void *m = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (m == MAP_FAILED) return fail(fileName, "cannot map");
+        mapped = m;
+        data = (const uint8_t*)mapped;
+#else
+        ifstream plik(fileName, ios::binary);
+        if (!plik.good()) return fail(fileName, "cannot open");
+        buffer.assign(istreambuf_iterator<char>(plik), istreambuf_iterator<char>());
+        if (buffer.size() < sizeof(WeightHeader)) return fail(fileName, "too short");
+        mappedSize = buffer.size();
+        data = (const uint8_t*)buffer.data();
+#endif
+        memcpy(&header, data, sizeof(WeightHeader));
+        if (memcmp(header.magic, WEIGHTS_MAGIC, 8) != 0) return fail(fileName, "not a weight file");
+        if (header.version != WEIGHTS_VERSION) return fail(fileName, "unsupported version " + to_string(header.version));
+        if (header.quantization != QUANT_FLOAT && header.quantization != QUANT_INT16) return fail(fileName, "unknown quantization");
+        if (inputTypeSize(header.inputType) == 0) return fail(fileName, "unknown input type " + to_string(header.inputType));
+        if (header.inputs < inputTypeSize(header.inputType)) return fail(fileName, to_string(header.inputs) + " inputs do not fit input type " + to_string(header.inputType));
+        if (header.payloadSize != mappedSize - sizeof(WeightHeader) || header.payloadSize != valueCount() * valueSize()) {
+            return fail(fileName, "size does not match the header");
+        }
+        if (fnv1a(payload(), header.payloadSize) != header.checksum) return fail(fileName, "checksum mismatch");
+        return true;
+    }
+
+    size_t valueCount() {
+        size_t n = (size_t)header.inputs * header.hidden;
+        if (header.architecture == NET_DEEP) n += (size_t)header.hidden * header.hidden2 + header.hidden2;
+        else n += header.hidden;
+        return n;
+    }
+
+    size_t valueSize() {
+        return header.quantization == QUANT_INT16 ? sizeof(int16_t) : sizeof(float);
+    }
+
+    const uint8_t* payload() {
+        return data + sizeof(WeightHeader);
+    }
+
+    // the weights themselves when stored as floats (the mapping is 64 byte aligned)
+    const float* floats() {
+        return header.quantization == QUANT_FLOAT ? (const float*)payload() : nullptr;
+    }
+
+    // copies count values from value offset, dequantized
+    void read(size_t offset, float *out, size_t count) {
+        if (header.quantization == QUANT_FLOAT) {
+            memcpy(out, payload() + offset * sizeof(float), count * sizeof(float));
+            return;
+        }
+        const uint8_t *p = payload() + offset * sizeof(int16_t);
+        for (size_t i=0; i < count; i++) {
+            int16_t v;
+            memcpy(&v, p + i * sizeof(int16_t), sizeof(int16_t));
+            out[i] = v * header.scale;
+        }
+    }
+
+    static bool write(const string & fileName, WeightHeader header, const vector<const vector<float>*> & arrays) {
+        memcpy(header.magic, WEIGHTS_MAGIC, 8);
+        header.version = WEIGHTS_VERSION;
+        header.reserved1 = 0;
+        memset(header.reserved, 0, sizeof(header.reserved));
+        vector<uint8_t> payload;
+        if (header.quantization == QUANT_INT16) {
+            float m = 0;
+            for (auto & a : arrays) for (auto & v : *a) m = max(m, abs(v));
+            header.scale = m > 0 ? m / 32767.0f : 1.0f;
+            for (auto & a : arrays) {
+                for (auto & v : *a) {
+                    int16_t q = (int16_t)round(v / header.scale);
+                    payload.insert(payload.end(), (uint8_t*)&q, (uint8_t*)&q + sizeof(q));
+                }
+            }
+        } else {
+            header.quantization = QUANT_FLOAT;
+            header.scale = 1.0f;
+            for (auto & a : arrays) {
+                payload.insert(payload.end(), (const uint8_t*)a->data(), (const uint8_t*)(a->data() + a->size()));
+            }
+        }
+        header.payloadSize = payload.size();
+        header.checksum = fnv1a(payload.data(), payload.size());
+        ofstream plik(fileName, ios::out | ios::binary);
+        plik.write((const char*)&header, sizeof(header));
+        plik.write((const char*)payload.data(), payload.size());
+        return plik.good();
+    }
+
+private:
+    void *mapped = nullptr;
+    size_t mappedSize = 0;
+    const uint8_t *data = nullptr;
+#ifdef _WIN32
+    vector<char> buffer;
+#endif
+
+    bool fail(const string & fileName, const string & reason) {
+        cerr << "cannot load " << fileName << ": " << reason << endl;
+        return false;
+    }
+};
+
+// float buffer starting on a 64 byte boundary
+class AlignedFloats {
+public:
+    float *data = nullptr;
+
+    void resize(size_t n) {
+        storage.assign(n + 16, 0.0f);
+        size_t misaligned = ((uintptr_t)storage.data() & 63) / sizeof(float);
+        data = storage.data() + (misaligned ? 16 - misaligned : 0);
+    }
+
+private:
+    vector<float> storage;
+};
+
+// Evaluation state of one search thread: the first layer sums of the position being expanded
+// and scratch for the layers above (single positions and blocks of EVAL_BATCH), so evaluating
+// allocates nothing. Buffers are 64 byte aligned and padded to whole cache lines, contexts of
+// different threads never share one.
+#define EVAL_BATCH 64
+
+class EvalContext {
+public:
+    float *accumulator = nullptr;
+    float *scores = nullptr;
+    float *scores2 = nullptr;
+    float *rows = nullptr;  // EVAL_BATCH x hidden
+    float *rows2 = nullptr; // EVAL_BATCH x hidden2
+
+    // sizes the buffers for a network, reallocates (dropping the accumulator) only to grow
+    void prepare(int hidden, int hidden2) {
+        if (hidden <= this->hidden && hidden2 <= this->hidden2) return;
+        this->hidden = max(hidden, this->hidden);
+        this->hidden2 = max(hidden2, this->hidden2);
+        size_t h = (this->hidden + 15) & ~15;
+        size_t h2 = (this->hidden2 + 15) & ~15;
+        buffer.resize((2 + EVAL_BATCH) * h + (1 + EVAL_BATCH) * h2);
+        accumulator = buffer.data;
+        scores = accumulator + h;
+        scores2 = scores + h;
+        rows = scores2 + h2;
+        rows2 = rows + EVAL_BATCH * h;
+    }
+
+private:
+    AlignedFloats buffer;
+    int hidden = 0;
+    int hidden2 = 0;
+};
+
+// Positions evaluated together against the one cached in the context, each given by the
+// features it adds to it. Engines fill it while generating the children of a node.
+class EvalBatch {
+public:
+    vector<int> indexes;    // features of all positions, one after another
+    vector<int> offsets{0}; // position i has indexes[offsets[i]] to indexes[offsets[i+1]-1]
+    vector<float> scores;   // for the side to move in each position
+
+    void clear() {
+        indexes.clear();
+        offsets.resize(1);
+        scores.clear();
+    }
+
+    void add(const vector<int> & features) {
+        indexes.insert(indexes.end(), features.begin(), features.end());
+        offsets.push_back(indexes.size());
+    }
+
+    int size() {
+        return offsets.size() - 1;
+    }
+};
+
+// What the engines need to evaluate positions. Implemented by the trainable Network and by
+// the smaller InferenceNetwork (inference.h) used for play.
+class INetwork {
 public:
-    const int inputs,hidden;
     int type = 0;
+    EvalCache *cache = nullptr; // optional, owned by the network
+
+    virtual ~INetwork() {
+        delete cache;
+    }
+    // keeps the first layer sums of a position in the context
+    virtual void cacheScore(const vector<int> & indexes, EvalContext & context) = 0;
+    // evaluates the cached position without indexesBase and with indexes
+    virtual float getScoreDiff(const vector<int> & indexesBase, const vector<int> & indexes, EvalContext & context) = 0;
+    virtual float getScore(const vector<int> & indexes, EvalContext & context) = 0;
+
+    // getScoreDiff of every position in the batch into batch.scores
+    virtual void getScoresDiff(EvalBatch & batch, EvalContext & context) {
+        vector<int> indexes;
+        batch.scores.resize(batch.size());
+        for (int i=0; i < batch.size(); i++) {
+            indexes.assign(batch.indexes.begin() + batch.offsets[i], batch.indexes.begin() + batch.offsets[i+1]);
+            batch.scores[i] = getScoreDiff({}, indexes, context);
+        }
+    }
+};
+
+// Per-thread buffers of Network::backprop, kept between samples so training doesn't allocate
+struct BackpropScratch {
+    vector<float> scores;
+    vector<float> scores2;
+    vector<float> dh;
+    vector<float> dh0;
+};
+
+class Network : public INetwork {
+public:
+    const int inputs,hidden;
     vector<float> hiddenWeights;
     vector<float> aHiddenWeights;
     vector<float> nHiddenWeights;
@@ -250,8 +535,6 @@ public:
     vector<float> nOutputWeights;
     vector<float> outputMomentum;
 
-    vector<float> cacheScores;
-
     float alpha = 0.001f;
     float mom = 0.8f;
 
@@ -265,8 +548,6 @@ public:
         nOutputWeights.resize(hidden);
         outputMomentum.resize(hidden);
 
-        cacheScores.resize(64 * hidden);
-
         Random random;
         for (auto & h : hiddenWeights) {
             h = random.nextFloat(-0.05f,0.05f);
@@ -276,100 +557,104 @@ public:
         }
     }
 
+    virtual ~Network() { }
+
     virtual void setWeights(Network *other) {
         this->hiddenWeights = other->hiddenWeights;
         this->outputWeights = other->outputWeights;
     }
 
-    virtual void load(string name) {
-        string name1 = std::to_string(hidden)+"_"+name;
-        // name1 = "/home/jacek/1projekty/PaperSoccer/96_RL9";
-        // cout << "load " << name1 << endl;
-        ifstream plik; plik.open(name1);
-        {
-            char result[sizeof(float) * hiddenWeights.size()];
-            plik.read(result, sizeof(float) * hiddenWeights.size());
-            memcpy(&hiddenWeights[0], result, sizeof(float) * hiddenWeights.size());
-        }
-        char result[sizeof(float) * outputWeights.size()];
-        plik.read(result, sizeof(float) * outputWeights.size());
-        memcpy(&outputWeights[0], result, sizeof(float) * outputWeights.size());
-        plik.close();
+    virtual int architecture() {
+        return NET_PLAIN;
     }
 
-    virtual void load2(string name1) {
-        cout << "load " << name1 << endl;
-        ifstream plik; plik.open(name1,std::ios::binary);
-        {
-            char result[sizeof(float) * hiddenWeights.size()];
-            plik.read(result, sizeof(float) * hiddenWeights.size());
-            memcpy(&hiddenWeights[0], result, sizeof(float) * hiddenWeights.size());
-        }
-        char result[sizeof(float) * outputWeights.size()];
-        plik.read(result, sizeof(float) * outputWeights.size());
-        memcpy(&outputWeights[0], result, sizeof(float) * outputWeights.size());
-        plik.close();
+    // weight arrays in file order
+    virtual vector<vector<float>*> weightArrays() {
+        return { &hiddenWeights, &outputWeights };
+    }
+
+    virtual bool load(string name) {
+        return loadWeights(std::to_string(hidden)+"_"+name);
+    }
+
+    virtual bool load2(string name1) {
+        cerr << "load " << name1 << endl;
+        return loadWeights(name1);
     }
 
     virtual void save(string name) {
         string name1 = std::to_string(hidden)+"_"+name;
         cout << "save " << name1 << endl;
-        ofstream plik; plik.open(name1, ios::out | ios::binary);
-        {
-            char result[sizeof(float) * hiddenWeights.size()];
-            memcpy(result, &hiddenWeights[0], sizeof(float) * hiddenWeights.size());
-            plik.write(result, sizeof(float) * hiddenWeights.size());
-        }
-        char result[sizeof(float) * outputWeights.size()];
-        memcpy(result, &outputWeights[0], sizeof(float) * outputWeights.size());
-        plik.write(result, sizeof(float) * outputWeights.size());
-        plik.close();
+        saveWeights(name1);
+    }
+
+    // weight file with a header, or an old raw file of exactly the expected size
+    bool loadWeights(const string & fileName) {
+        auto arrays = weightArrays();
+        size_t expected = 0;
+        for (auto & a : arrays) expected += a->size();
+
+        if (WeightFile::hasHeader(fileName)) {
+            WeightFile file;
+            if (!file.open(fileName)) return false;
+            auto & h = file.header;
+            if ((int)h.architecture != architecture() || (int)h.inputs != inputs || (int)h.hidden != hidden || file.valueCount() != expected) {
+                cerr << "cannot load " << fileName << ": it is a " << h.inputs << "x" << h.hidden;
+                if (h.architecture == NET_DEEP) cerr << "x" << h.hidden2;
+                cerr << " network" << endl;
+                return false;
+            }
+            size_t offset = 0;
+            for (auto & a : arrays) {
+                file.read(offset, a->data(), a->size());
+                offset += a->size();
+            }
+            type = h.inputType;
+            return true;
+        }
+
+        ifstream plik(fileName, ios::binary | ios::ate);
+        if (!plik.good()) {
+            cerr << "cannot load " << fileName << ": cannot open" << endl;
+            return false;
+        }
+        if ((size_t)plik.tellg() != expected * sizeof(float)) {
+            cerr << "cannot load " << fileName << ": size does not match the network dimensions" << endl;
+            return false;
+        }
+        plik.seekg(0);
+        for (auto & a : arrays) {
+            plik.read((char*)a->data(), sizeof(float) * a->size());
+        }
+        return plik.good();
+    }
+
+    bool saveWeights(const string & fileName, int quantization = QUANT_FLOAT) {
+        WeightHeader header;
+        memset(&header, 0, sizeof(header));
+        header.architecture = architecture();
+        header.inputType = type;
+        header.inputs = inputs;
+        header.hidden = hidden;
+        header.hidden2 = architecture() == NET_DEEP ? outputWeights.size() : 0;
+        header.quantization = quantization;
+        vector<const vector<float>*> arrays;
+        for (auto & a : weightArrays()) arrays.push_back(a);
+        return WeightFile::write(fileName, header, arrays);
     }
 
     virtual void loadCheckpoint(string name) {
         string name1 = "_"+std::to_string(hidden)+"_"+name;
         cout << "load checkpoint " << name1 << endl;
         ifstream plik; plik.open(name1);
-        {
-            char result[sizeof(float) * hiddenWeights.size()];
-            plik.read(result, sizeof(float) * hiddenWeights.size());
-            memcpy(&hiddenWeights[0], result, sizeof(float) * hiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * hiddenMomentum.size()];
-            plik.read(result, sizeof(float) * hiddenMomentum.size());
-            memcpy(&hiddenMomentum[0], result, sizeof(float) * hiddenMomentum.size());
-        }
-        {
-            char result[sizeof(float) * aHiddenWeights.size()];
-            plik.read(result, sizeof(float) * aHiddenWeights.size());
-            memcpy(&aHiddenWeights[0], result, sizeof(float) * aHiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * nHiddenWeights.size()];
-            plik.read(result, sizeof(float) * nHiddenWeights.size());
-            memcpy(&nHiddenWeights[0], result, sizeof(float) * nHiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * outputWeights.size()];
-            plik.read(result, sizeof(float) * outputWeights.size());
-            memcpy(&outputWeights[0], result, sizeof(float) * outputWeights.size());
-        }
-        {
-            char result[sizeof(float) * outputMomentum.size()];
-            plik.read(result, sizeof(float) * outputMomentum.size());
-            memcpy(&outputMomentum[0], result, sizeof(float) * outputMomentum.size());
-        }
-        {
-            char result[sizeof(float) * aOutputWeights.size()];
-            plik.read(result, sizeof(float) * aOutputWeights.size());
-            memcpy(&aOutputWeights[0], result, sizeof(float) * aOutputWeights.size());
-        }
-        {
-            char result[sizeof(float) * nOutputWeights.size()];
-            plik.read(result, sizeof(float) * nOutputWeights.size());
-            memcpy(&nOutputWeights[0], result, sizeof(float) * nOutputWeights.size());
-        }
+        plik.read((char*)hiddenWeights.data(), sizeof(float) * hiddenWeights.size());
+        plik.read((char*)hiddenMomentum.data(), sizeof(float) * hiddenMomentum.size());
+        plik.read((char*)aHiddenWeights.data(), sizeof(float) * aHiddenWeights.size());
+        plik.read((char*)nHiddenWeights.data(), sizeof(float) * nHiddenWeights.size());
+        plik.read((char*)outputWeights.data(), sizeof(float) * outputWeights.size());
+        plik.read((char*)outputMomentum.data(), sizeof(float) * outputMomentum.size());
+        plik.read((char*)aOutputWeights.data(), sizeof(float) * aOutputWeights.size());
+        plik.read((char*)nOutputWeights.data(), sizeof(float) * nOutputWeights.size());
 
         plik.close();
     }
@@ -378,46 +663,14 @@ public:
         string name1 = "_"+std::to_string(hidden)+"_"+name;
         cout << "save checkpoint " << name1 << endl;
         ofstream plik; plik.open(name1, ios::out | ios::binary);
-        {
-            char result[sizeof(float) * hiddenWeights.size()];
-            memcpy(result, &hiddenWeights[0], sizeof(float) * hiddenWeights.size());
-            plik.write(result, sizeof(float) * hiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * hiddenMomentum.size()];
-            memcpy(result, &hiddenMomentum[0], sizeof(float) * hiddenMomentum.size());
-            plik.write(result, sizeof(float) * hiddenMomentum.size());
-        }
-        {
-            char result[sizeof(float) * aHiddenWeights.size()];
-            memcpy(result, &aHiddenWeights[0], sizeof(float) * aHiddenWeights.size());
-            plik.write(result, sizeof(float) * aHiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * nHiddenWeights.size()];
-            memcpy(result, &nHiddenWeights[0], sizeof(float) * nHiddenWeights.size());
-            plik.write(result, sizeof(float) * nHiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * outputWeights.size()];
-            memcpy(result, &outputWeights[0], sizeof(float) * outputWeights.size());
-            plik.write(result, sizeof(float) * outputWeights.size());
-        }
-        {
-            char result[sizeof(float) * outputMomentum.size()];
-            memcpy(result, &outputMomentum[0], sizeof(float) * outputMomentum.size());
-            plik.write(result, sizeof(float) * outputMomentum.size());
-        }
-        {
-            char result[sizeof(float) * aOutputWeights.size()];
-            memcpy(result, &aOutputWeights[0], sizeof(float) * aOutputWeights.size());
-            plik.write(result, sizeof(float) * aOutputWeights.size());
-        }
-        {
-            char result[sizeof(float) * nOutputWeights.size()];
-            memcpy(result, &nOutputWeights[0], sizeof(float) * nOutputWeights.size());
-            plik.write(result, sizeof(float) * nOutputWeights.size());
-        }
+        plik.write((const char*)hiddenWeights.data(), sizeof(float) * hiddenWeights.size());
+        plik.write((const char*)hiddenMomentum.data(), sizeof(float) * hiddenMomentum.size());
+        plik.write((const char*)aHiddenWeights.data(), sizeof(float) * aHiddenWeights.size());
+        plik.write((const char*)nHiddenWeights.data(), sizeof(float) * nHiddenWeights.size());
+        plik.write((const char*)outputWeights.data(), sizeof(float) * outputWeights.size());
+        plik.write((const char*)outputMomentum.data(), sizeof(float) * outputMomentum.size());
+        plik.write((const char*)aOutputWeights.data(), sizeof(float) * aOutputWeights.size());
+        plik.write((const char*)nOutputWeights.data(), sizeof(float) * nOutputWeights.size());
         plik.close();
     }
 
@@ -451,31 +704,40 @@ public:
         }
     }
 
-    virtual void cacheScore(const vector<int> & indexes, int id) {
+    // outputWeights has one weight per unit of the last hidden layer, which sizes scores2
+    virtual void cacheScore(const vector<int> & indexes, EvalContext & context) {
+        context.prepare(hidden, outputWeights.size());
+        float *accumulator = context.accumulator;
         for (int i=0; i < hidden; i++) {
-            cacheScores[id * hidden + i] = 0;
+            accumulator[i] = 0;
         }
         for (auto & index : indexes) {
+            const float *row = &hiddenWeights[index*hidden];
             for (int i=0; i < hidden; i++) {
-                cacheScores[id * hidden + i] += hiddenWeights[index*hidden+i];
+                accumulator[i] += row[i];
             }
         }
     }
 
-    virtual float getScoreDiff(const vector<int> & indexesBase, const vector<int> & indexes, int id) {
-        vector<float> scores(hidden);
+    virtual float getScoreDiff(const vector<int> & indexesBase, const vector<int> & indexes, EvalContext & context) {
+        float *scores = context.scores;
+        for (int i=0; i < hidden; i++) {
+            scores[i] = context.accumulator[i];
+        }
         for (auto & index : indexesBase) {
+            const float *row = &hiddenWeights[index*hidden];
             for (int i=0; i < hidden; i++) {
-                scores[i] -= hiddenWeights[index*hidden+i];
+                scores[i] -= row[i];
             }
         }
         for (auto & index : indexes) {
+            const float *row = &hiddenWeights[index*hidden];
             for (int i=0; i < hidden; i++) {
-                scores[i] += hiddenWeights[index*hidden+i];
+                scores[i] += row[i];
             }
         }
         for (int i=0; i < hidden; i++) {
-            scores[i] = relu(cacheScores[id * hidden + i] + scores[i]);
+            scores[i] = relu(scores[i]);
         }
 
         float output = 0.0f;
@@ -486,11 +748,16 @@ public:
         return fast_tanh(output);
     }
 
-    virtual float getScore(const vector<int> & indexes) {
-        vector<float> scores(hidden);
+    virtual float getScore(const vector<int> & indexes, EvalContext & context) {
+        context.prepare(hidden, outputWeights.size());
+        float *scores = context.scores;
+        for (int i=0; i < hidden; i++) {
+            scores[i] = 0;
+        }
         for (auto & index : indexes) {
+            const float *row = &hiddenWeights[index*hidden];
             for (int i=0; i < hidden; i++) {
-                scores[i] += hiddenWeights[index*hidden+i];
+                scores[i] += row[i];
             }
         }
         for (int i=0; i < hidden; i++) {
@@ -548,6 +815,60 @@ public:
         }
     }
 
+    // One sample of a mini-batch. The touched first layer rows are updated in place, threads share
+    // them without locks (Hogwild). The dense gradients are summed into gradHidden2/gradOutput and
+    // applied once per batch with applyGradients. Returns the squared error.
+    virtual float backprop(const int *indexes, int count, float target, BackpropScratch & scratch, vector<float> & /*gradHidden2*/, vector<float> & gradOutput) {
+        vector<float> & scores = scratch.scores;
+        scores.assign(hidden, 0.0f);
+        for (int k=0; k < count; k++) {
+            int index = indexes[k];
+            for (int i=0; i < hidden; i++) {
+                scores[i] += hiddenWeights[index*hidden+i];
+            }
+        }
+        for (int i=0; i < hidden; i++) {
+            scores[i] = relu(scores[i]);
+        }
+
+        float op = 0.0;
+        for (int i=0; i < hidden; i++) {
+            op += outputWeights[i] * scores[i];
+        }
+        op = fast_tanh(op);
+
+        float e = target - op;
+        float dop = e * dtanh(op);
+
+        vector<float> & dh = scratch.dh;
+        dh.resize(hidden);
+        for (int i=0; i < hidden; i++) {
+            gradOutput[i] += scores[i] * dop;
+            dh[i] = alpha * dop * outputWeights[i] * drelu(scores[i]);
+        }
+
+        for (int k=0; k < count; k++) {
+            int index = indexes[k];
+            float *row = &hiddenWeights[index*hidden];
+            for (int i=0; i < hidden; i++) {
+                row[i] += dh[i];
+            }
+        }
+        return e*e;
+    }
+
+    virtual int hiddenWeights2Size() {
+        return 0;
+    }
+
+    // momentum step with gradients summed over a mini-batch
+    virtual void applyGradients(const vector<float> & /*gradHidden2*/, const vector<float> & gradOutput) {
+        for (int i=0; i < hidden; i++) {
+            outputMomentum[i] = mom * outputMomentum[i] + alpha * gradOutput[i];
+            outputWeights[i] += outputMomentum[i];
+        }
+    }
+
     virtual void learnRL(const vector<int> & indexes, float target) {
         vector<float> scores(hidden);
         for (auto & index : indexes) {
@@ -735,20 +1056,29 @@ public:
 
     }
 
-    virtual float getScoreDiff(const vector<int> & indexesBase, const vector<int> & indexes, int id) {
-        vector<float> scores(hidden);
+    virtual int architecture() {
+        return NET_SCRELU;
+    }
+
+    virtual float getScoreDiff(const vector<int> & indexesBase, const vector<int> & indexes, EvalContext & context) {
+        float *scores = context.scores;
+        for (int i=0; i < hidden; i++) {
+            scores[i] = context.accumulator[i];
+        }
         for (auto & index : indexesBase) {
+            const float *row = &hiddenWeights[index*hidden];
             for (int i=0; i < hidden; i++) {
-                scores[i] -= hiddenWeights[index*hidden+i];
+                scores[i] -= row[i];
             }
         }
         for (auto & index : indexes) {
+            const float *row = &hiddenWeights[index*hidden];
             for (int i=0; i < hidden; i++) {
-                scores[i] += hiddenWeights[index*hidden+i];
+                scores[i] += row[i];
             }
         }
         for (int i=0; i < hidden; i++) {
-            scores[i] = relu2(cacheScores[id * hidden + i] + scores[i]);
+            scores[i] = relu2(scores[i]);
         }
 
         float output = 0.0f;
@@ -759,11 +1089,16 @@ public:
         return fast_tanh(output);
     }
 
-    virtual float getScore(const vector<int> & indexes) {
-        vector<float> scores(hidden);
+    virtual float getScore(const vector<int> & indexes, EvalContext & context) {
+        context.prepare(hidden, outputWeights.size());
+        float *scores = context.scores;
+        for (int i=0; i < hidden; i++) {
+            scores[i] = 0;
+        }
         for (auto & index : indexes) {
+            const float *row = &hiddenWeights[index*hidden];
             for (int i=0; i < hidden; i++) {
-                scores[i] += hiddenWeights[index*hidden+i];
+                scores[i] += row[i];
             }
         }
         for (int i=0; i < hidden; i++) {
@@ -821,6 +1156,45 @@ public:
         }
     }
 
+    virtual float backprop(const int *indexes, int count, float target, BackpropScratch & scratch, vector<float> & /*gradHidden2*/, vector<float> & gradOutput) {
+        vector<float> & scores = scratch.scores;
+        scores.assign(hidden, 0.0f);
+        for (int k=0; k < count; k++) {
+            int index = indexes[k];
+            for (int i=0; i < hidden; i++) {
+                scores[i] += hiddenWeights[index*hidden+i];
+            }
+        }
+        for (int i=0; i < hidden; i++) {
+            scores[i] = relu2(scores[i]);
+        }
+
+        float op = 0.0;
+        for (int i=0; i < hidden; i++) {
+            op += outputWeights[i] * scores[i];
+        }
+        op = fast_tanh(op);
+
+        float e = target - op;
+        float dop = e * dtanh(op);
+
+        vector<float> & dh = scratch.dh;
+        dh.resize(hidden);
+        for (int i=0; i < hidden; i++) {
+            gradOutput[i] += scores[i] * dop;
+            dh[i] = alpha * dop * outputWeights[i] * drelu2(scores[i]);
+        }
+
+        for (int k=0; k < count; k++) {
+            int index = indexes[k];
+            float *row = &hiddenWeights[index*hidden];
+            for (int i=0; i < hidden; i++) {
+                row[i] += dh[i];
+            }
+        }
+        return e*e;
+    }
+
     virtual void learnRL(const vector<int> & indexes, float target) {
         vector<float> scores(hidden);
         for (auto & index : indexes) {
@@ -936,109 +1310,35 @@ public:
         }
     }
 
-    virtual void load(string name1) {
-        cout << "load " << name1 << endl;
-        ifstream plik; plik.open(name1,ios::binary);
-        {
-            char result[sizeof(float) * hiddenWeights.size()];
-            plik.read(result, sizeof(float) * hiddenWeights.size());
-            memcpy(&hiddenWeights[0], result, sizeof(float) * hiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * hiddenWeights2.size()];
-            plik.read(result, sizeof(float) * hiddenWeights2.size());
-            memcpy(&hiddenWeights2[0], result, sizeof(float) * hiddenWeights2.size());
-        }
-        char result[sizeof(float) * outputWeights.size()];
-        plik.read(result, sizeof(float) * outputWeights.size());
-        memcpy(&outputWeights[0], result, sizeof(float) * outputWeights.size());
-        plik.close();
+    virtual int architecture() {
+        return NET_DEEP;
     }
 
-    virtual void save(string name) {
-        string name1 = std::to_string(hidden)+"_"+name;
-        cout << "save " << name1 << endl;
-        ofstream plik; plik.open(name1, ios::out | ios::binary);
-        {
-            char result[sizeof(float) * hiddenWeights.size()];
-            memcpy(result, &hiddenWeights[0], sizeof(float) * hiddenWeights.size());
-            plik.write(result, sizeof(float) * hiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * hiddenWeights2.size()];
-            memcpy(result, &hiddenWeights2[0], sizeof(float) * hiddenWeights2.size());
-            plik.write(result, sizeof(float) * hiddenWeights2.size());
-        }
-        char result[sizeof(float) * outputWeights.size()];
-        memcpy(result, &outputWeights[0], sizeof(float) * outputWeights.size());
-        plik.write(result, sizeof(float) * outputWeights.size());
-        plik.close();
+    virtual vector<vector<float>*> weightArrays() {
+        return { &hiddenWeights, &hiddenWeights2, &outputWeights };
+    }
+
+    virtual bool load(string name1) {
+        cerr << "load " << name1 << endl;
+        return loadWeights(name1);
     }
 
     virtual void loadCheckpoint(string name) {
         string name1 = "_"+std::to_string(hidden)+"_"+name;
         cout << "load checkpoint " << name1 << endl;
         ifstream plik; plik.open(name1);
-        {
-            char result[sizeof(float) * hiddenWeights.size()];
-            plik.read(result, sizeof(float) * hiddenWeights.size());
-            memcpy(&hiddenWeights[0], result, sizeof(float) * hiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * hiddenMomentum.size()];
-            plik.read(result, sizeof(float) * hiddenMomentum.size());
-            memcpy(&hiddenMomentum[0], result, sizeof(float) * hiddenMomentum.size());
-        }
-        {
-            char result[sizeof(float) * aHiddenWeights.size()];
-            plik.read(result, sizeof(float) * aHiddenWeights.size());
-            memcpy(&aHiddenWeights[0], result, sizeof(float) * aHiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * nHiddenWeights.size()];
-            plik.read(result, sizeof(float) * nHiddenWeights.size());
-            memcpy(&nHiddenWeights[0], result, sizeof(float) * nHiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * hiddenWeights2.size()];
-            plik.read(result, sizeof(float) * hiddenWeights2.size());
-            memcpy(&hiddenWeights2[0], result, sizeof(float) * hiddenWeights2.size());
-        }
-        {
-            char result[sizeof(float) * hiddenMomentum2.size()];
-            plik.read(result, sizeof(float) * hiddenMomentum2.size());
-            memcpy(&hiddenMomentum2[0], result, sizeof(float) * hiddenMomentum2.size());
-        }
-        {
-            char result[sizeof(float) * aHiddenWeights2.size()];
-            plik.read(result, sizeof(float) * aHiddenWeights2.size());
-            memcpy(&aHiddenWeights2[0], result, sizeof(float) * aHiddenWeights2.size());
-        }
-        {
-            char result[sizeof(float) * nHiddenWeights2.size()];
-            plik.read(result, sizeof(float) * nHiddenWeights2.size());
-            memcpy(&nHiddenWeights2[0], result, sizeof(float) * nHiddenWeights2.size());
-        }
-        {
-            char result[sizeof(float) * outputWeights.size()];
-            plik.read(result, sizeof(float) * outputWeights.size());
-            memcpy(&outputWeights[0], result, sizeof(float) * outputWeights.size());
-        }
-        {
-            char result[sizeof(float) * outputMomentum.size()];
-            plik.read(result, sizeof(float) * outputMomentum.size());
-            memcpy(&outputMomentum[0], result, sizeof(float) * outputMomentum.size());
-        }
-        {
-            char result[sizeof(float) * aOutputWeights.size()];
-            plik.read(result, sizeof(float) * aOutputWeights.size());
-            memcpy(&aOutputWeights[0], result, sizeof(float) * aOutputWeights.size());
-        }
-        {
-            char result[sizeof(float) * nOutputWeights.size()];
-            plik.read(result, sizeof(float) * nOutputWeights.size());
-            memcpy(&nOutputWeights[0], result, sizeof(float) * nOutputWeights.size());
-        }
+        plik.read((char*)hiddenWeights.data(), sizeof(float) * hiddenWeights.size());
+        plik.read((char*)hiddenMomentum.data(), sizeof(float) * hiddenMomentum.size());
+        plik.read((char*)aHiddenWeights.data(), sizeof(float) * aHiddenWeights.size());
+        plik.read((char*)nHiddenWeights.data(), sizeof(float) * nHiddenWeights.size());
+        plik.read((char*)hiddenWeights2.data(), sizeof(float) * hiddenWeights2.size());
+        plik.read((char*)hiddenMomentum2.data(), sizeof(float) * hiddenMomentum2.size());
+        plik.read((char*)aHiddenWeights2.data(), sizeof(float) * aHiddenWeights2.size());
+        plik.read((char*)nHiddenWeights2.data(), sizeof(float) * nHiddenWeights2.size());
+        plik.read((char*)outputWeights.data(), sizeof(float) * outputWeights.size());
+        plik.read((char*)outputMomentum.data(), sizeof(float) * outputMomentum.size());
+        plik.read((char*)aOutputWeights.data(), sizeof(float) * aOutputWeights.size());
+        plik.read((char*)nOutputWeights.data(), sizeof(float) * nOutputWeights.size());
 
         plik.close();
     }
@@ -1047,99 +1347,50 @@ public:
         string name1 = "_"+std::to_string(hidden)+"_"+name;
         cout << "save checkpoint " << name1 << endl;
         ofstream plik; plik.open(name1, ios::out | ios::binary);
-        {
-            char result[sizeof(float) * hiddenWeights.size()];
-            memcpy(result, &hiddenWeights[0], sizeof(float) * hiddenWeights.size());
-            plik.write(result, sizeof(float) * hiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * hiddenMomentum.size()];
-            memcpy(result, &hiddenMomentum[0], sizeof(float) * hiddenMomentum.size());
-            plik.write(result, sizeof(float) * hiddenMomentum.size());
-        }
-        {
-            char result[sizeof(float) * aHiddenWeights.size()];
-            memcpy(result, &aHiddenWeights[0], sizeof(float) * aHiddenWeights.size());
-            plik.write(result, sizeof(float) * aHiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * nHiddenWeights.size()];
-            memcpy(result, &nHiddenWeights[0], sizeof(float) * nHiddenWeights.size());
-            plik.write(result, sizeof(float) * nHiddenWeights.size());
-        }
-        {
-            char result[sizeof(float) * hiddenWeights2.size()];
-            memcpy(result, &hiddenWeights2[0], sizeof(float) * hiddenWeights2.size());
-            plik.write(result, sizeof(float) * hiddenWeights2.size());
-        }
-        {
-            char result[sizeof(float) * hiddenMomentum2.size()];
-            memcpy(result, &hiddenMomentum2[0], sizeof(float) * hiddenMomentum2.size());
-            plik.write(result, sizeof(float) * hiddenMomentum2.size());
-        }
-        {
-            char result[sizeof(float) * aHiddenWeights2.size()];
-            memcpy(result, &aHiddenWeights2[0], sizeof(float) * aHiddenWeights2.size());
-            plik.write(result, sizeof(float) * aHiddenWeights2.size());
-        }
-        {
-            char result[sizeof(float) * nHiddenWeights2.size()];
-            memcpy(result, &nHiddenWeights2[0], sizeof(float) * nHiddenWeights2.size());
-            plik.write(result, sizeof(float) * nHiddenWeights2.size());
-        }
-        {
-            char result[sizeof(float) * outputWeights.size()];
-            memcpy(result, &outputWeights[0], sizeof(float) * outputWeights.size());
-            plik.write(result, sizeof(float) * outputWeights.size());
-        }
-        {
-            char result[sizeof(float) * outputMomentum.size()];
-            memcpy(result, &outputMomentum[0], sizeof(float) * outputMomentum.size());
-            plik.write(result, sizeof(float) * outputMomentum.size());
-        }
-        {
-            char result[sizeof(float) * aOutputWeights.size()];
-            memcpy(result, &aOutputWeights[0], sizeof(float) * aOutputWeights.size());
-            plik.write(result, sizeof(float) * aOutputWeights.size());
-        }
-        {
-            char result[sizeof(float) * nOutputWeights.size()];
-            memcpy(result, &nOutputWeights[0], sizeof(float) * nOutputWeights.size());
-            plik.write(result, sizeof(float) * nOutputWeights.size());
-        }
+        plik.write((const char*)hiddenWeights.data(), sizeof(float) * hiddenWeights.size());
+        plik.write((const char*)hiddenMomentum.data(), sizeof(float) * hiddenMomentum.size());
+        plik.write((const char*)aHiddenWeights.data(), sizeof(float) * aHiddenWeights.size());
+        plik.write((const char*)nHiddenWeights.data(), sizeof(float) * nHiddenWeights.size());
+        plik.write((const char*)hiddenWeights2.data(), sizeof(float) * hiddenWeights2.size());
+        plik.write((const char*)hiddenMomentum2.data(), sizeof(float) * hiddenMomentum2.size());
+        plik.write((const char*)aHiddenWeights2.data(), sizeof(float) * aHiddenWeights2.size());
+        plik.write((const char*)nHiddenWeights2.data(), sizeof(float) * nHiddenWeights2.size());
+        plik.write((const char*)outputWeights.data(), sizeof(float) * outputWeights.size());
+        plik.write((const char*)outputMomentum.data(), sizeof(float) * outputMomentum.size());
+        plik.write((const char*)aOutputWeights.data(), sizeof(float) * aOutputWeights.size());
+        plik.write((const char*)nOutputWeights.data(), sizeof(float) * nOutputWeights.size());
         plik.close();
     }
 
-    virtual float getScoreDiff(const vector<int> & indexesBase, const vector<int> & indexes, int id) {
-        vector<float> scores(hidden);
+    virtual float getScoreDiff(const vector<int> & indexesBase, const vector<int> & indexes, EvalContext & context) {
+        float *scores = context.scores;
+        for (int i=0; i < hidden; i++) {
+            scores[i] = context.accumulator[i];
+        }
         for (auto & index : indexesBase) {
+            const float *row = &hiddenWeights[index*hidden];
             for (int i=0; i < hidden; i++) {
-                scores[i] -= hiddenWeights[index*hidden+i];
+                scores[i] -= row[i];
             }
         }
         for (auto & index : indexes) {
+            const float *row = &hiddenWeights[index*hidden];
             for (int i=0; i < hidden; i++) {
-                scores[i] += hiddenWeights[index*hidden+i];
+                scores[i] += row[i];
             }
         }
         for (int i=0; i < hidden; i++) {
-            scores[i] = relu2(cacheScores[id * hidden + i] + scores[i]);
+            scores[i] = relu2(scores[i]);
         }
 
-        // float output = 0;
-        // for (int i=0; i < hidden2; i++) {
-        //     float score = 0.0;
-        //     for (int j=0; j < hidden; j++) {
-        //         score += scores[j] * hiddenWeights2[i*hidden+j];
-        //     }
-        //     score = relu(score);
-        //     output += outputWeights[i] * score;
-        // }
-
-        vector<float> scores2(hidden2);
+        float *scores2 = context.scores2;
+        for (int j=0; j < hidden2; j++) {
+            scores2[j] = 0;
+        }
         for (int i=0; i < hidden; i++) {
+            const float *w = &hiddenWeights2[i*hidden2];
             for (int j=0; j < hidden2; j++) {
-                scores2[j] += hiddenWeights2[i*hidden2+j] * scores[i];
+                scores2[j] += w[j] * scores[i];
             }
         }
         for (int i=0; i < hidden2; i++) {
@@ -1154,31 +1405,30 @@ public:
         return fast_tanh(output);
     }
 
-    virtual float getScore(const vector<int> & indexes) {
-        vector<float> scores(hidden);
+    virtual float getScore(const vector<int> & indexes, EvalContext & context) {
+        context.prepare(hidden, outputWeights.size());
+        float *scores = context.scores;
+        for (int i=0; i < hidden; i++) {
+            scores[i] = 0;
+        }
         for (auto & index : indexes) {
+            const float *row = &hiddenWeights[index*hidden];
             for (int i=0; i < hidden; i++) {
-                scores[i] += hiddenWeights[index*hidden+i];
+                scores[i] += row[i];
             }
         }
         for (int i=0; i < hidden; i++) {
             scores[i] = relu2(scores[i]);
         }
 
-        // float output = 0;
-        // for (int i=0; i < hidden2; i++) {
-        //     float score = 0.0;
-        //     for (int j=0; j < hidden; j++) {
-        //         score += scores[j] * hiddenWeights2[i*hidden+j];
-        //     }
-        //     score = relu(score);
-        //     output += outputWeights[i] * score;
-        // }
-
-        vector<float> scores2(hidden2);
+        float *scores2 = context.scores2;
+        for (int j=0; j < hidden2; j++) {
+            scores2[j] = 0;
+        }
         for (int i=0; i < hidden; i++) {
+            const float *w = &hiddenWeights2[i*hidden2];
             for (int j=0; j < hidden2; j++) {
-                scores2[j] += hiddenWeights2[i*hidden2+j] * scores[i];
+                scores2[j] += w[j] * scores[i];
             }
         }
         for (int i=0; i < hidden2; i++) {
@@ -1261,6 +1511,86 @@ public:
         }
     }
 
+    virtual int hiddenWeights2Size() {
+        return hiddenWeights2.size();
+    }
+
+    virtual float backprop(const int *indexes, int count, float target, BackpropScratch & scratch, vector<float> & gradHidden2, vector<float> & gradOutput) {
+        vector<float> & scores = scratch.scores;
+        scores.assign(hidden, 0.0f);
+        for (int k=0; k < count; k++) {
+            int index = indexes[k];
+            const float *row = &hiddenWeights[index*hidden];
+            for (int i=0; i < hidden; i++) {
+                scores[i] += row[i];
+            }
+        }
+        for (int i=0; i < hidden; i++) {
+            scores[i] = relu2(scores[i]);
+        }
+
+        vector<float> & scores2 = scratch.scores2;
+        scores2.assign(hidden2, 0.0f);
+        for (int i=0; i < hidden; i++) {
+            const float *w = &hiddenWeights2[i*hidden2];
+            for (int j=0; j < hidden2; j++) {
+                scores2[j] += w[j] * scores[i];
+            }
+        }
+        for (int i=0; i < hidden2; i++) {
+            scores2[i] = relu(scores2[i]);
+        }
+
+        float op = 0.0;
+        for (int i=0; i < hidden2; i++) {
+            op += outputWeights[i] * scores2[i];
+        }
+        op = fast_tanh(op);
+
+        float e = target - op;
+        float dop = e * dtanh(op);
+
+        vector<float> & dh = scratch.dh;
+        dh.resize(hidden2);
+        for (int i=0; i < hidden2; i++) {
+            gradOutput[i] += scores2[i] * dop;
+            dh[i] = dop * outputWeights[i] * drelu(scores2[i]);
+        }
+
+        vector<float> & dh0 = scratch.dh0;
+        dh0.resize(hidden);
+        for (int i=0; i < hidden; i++) {
+            const float *w = &hiddenWeights2[i*hidden2];
+            float *g = &gradHidden2[i*hidden2];
+            float sum = 0;
+            for (int j=0; j < hidden2; j++) {
+                sum += dh[j] * w[j];
+                g[j] += dh[j] * scores[i];
+            }
+            dh0[i] = alpha * sum * drelu2(scores[i]);
+        }
+
+        for (int k=0; k < count; k++) {
+            int index = indexes[k];
+            float *row = &hiddenWeights[index*hidden];
+            for (int i=0; i < hidden; i++) {
+                row[i] += dh0[i];
+            }
+        }
+        return e*e;
+    }
+
+    virtual void applyGradients(const vector<float> & gradHidden2, const vector<float> & gradOutput) {
+        for (int i=0; i < hidden2; i++) {
+            outputMomentum[i] = mom * outputMomentum[i] + alpha * gradOutput[i];
+            outputWeights[i] += outputMomentum[i];
+        }
+        for (size_t i=0; i < hiddenWeights2.size(); i++) {
+            hiddenMomentum2[i] = mom * hiddenMomentum2[i] + alpha * gradHidden2[i];
+            hiddenWeights2[i] += hiddenMomentum2[i];
+        }
+    }
+
     virtual void learnRL(const vector<int> & indexes, float target) {
         vector<float> scores(hidden);
         for (auto & index : indexes) {
@@ -1396,4 +1726,29 @@ public:
 };
 
 
+// network described by the header of a weight file, old raw files are NetworkDeep
+// of the given dimensions; nullptr if the file cannot be used
+Network* createNetwork(const string & fileName, int hidden = 96, int hidden2 = 32) {
+    cerr << "load " << fileName << endl;
+    Network *network;
+    int type = 2;
+    if (WeightFile::hasHeader(fileName)) {
+        WeightFile file;
+        if (!file.open(fileName)) return nullptr;
+        auto & h = file.header;
+        if (h.architecture == NET_DEEP) network = new NetworkDeep(h.inputs,h.hidden,h.hidden2);
+        else if (h.architecture == NET_SCRELU) network = new NetworkScrelu(h.inputs,h.hidden);
+        else network = new Network(h.inputs,h.hidden);
+        type = h.inputType;
+    } else {
+        network = new NetworkDeep(1466,hidden,hidden2);
+    }
+    if (!network->loadWeights(fileName)) {
+        delete network;
+        return nullptr;
+    }
+    network->type = type;
+    return network;
+}
+
 #endif // NETWORK_H
@@ -0,0 +1,122 @@
+#ifndef OPENINGBOOK_H
+#define OPENINGBOOK_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include "game.h"
+#include "random.h"
+#include "mappedfile.h"
+
+using namespace std;
+
+// Book file: 32 byte header, then entries sorted by key and, for one key, the best move first.
+// key is Pitch::getKey of the player to move, so the book needs no game history.
+#define BOOK_MAGIC "PSBOOK01"
+#define BOOK_VERSION 1
+#define BOOK_MOVE 48 // longest turn kept, with the terminating zero
+
+struct BookHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint32_t checksum;
+    char reserved[12];
+};
+
+static_assert(sizeof(BookHeader) == 32, "BookHeader must be 32 bytes");
+
+struct BookEntry {
+    uint64_t key;
+    int32_t visits;
+    float winRate; // percent, for the player to move
+    char move[BOOK_MOVE];
+};
+
+static_assert(sizeof(BookEntry) == 64, "BookEntry must be 64 bytes");
+
+// Read-only mapping of a book file, shared by the processes using it. Lookups are binary
+// searches, safe from any thread.
+class OpeningBook {
+public:
+    OpeningBook() {}
+
+    OpeningBook(const OpeningBook &) = delete;
+    OpeningBook & operator=(const OpeningBook &) = delete;
+
+    // maps the file and checks header, size and checksum, prints the reason on failure
+    bool open(const string & fileName) {
+        if (!file.open(fileName)) return fail(fileName, "cannot open");
+        if (file.size < sizeof(BookHeader)) return fail(fileName, "too short");
+        BookHeader header;
+        memcpy(&header, file.data, sizeof(BookHeader));
+        if (memcmp(header.magic, BOOK_MAGIC, 8) != 0) return fail(fileName, "not a book file");
+        if (header.version != BOOK_VERSION) return fail(fileName, "unsupported version " + to_string(header.version));
+        if (file.size != sizeof(BookHeader) + (size_t)header.count * sizeof(BookEntry)) return fail(fileName, "size does not match the header");
+        entries = (const BookEntry*)(file.data + sizeof(BookHeader));
+        if (fnv1a((const uint8_t*)entries, (size_t)header.count * sizeof(BookEntry)) != header.checksum) return fail(fileName, "checksum mismatch");
+        count = header.count;
+        return true;
+    }
+
+    bool isOpen() {
+        return entries != nullptr;
+    }
+
+    int size() {
+        return count;
+    }
+
+    // best book move of the position, nullptr if it's not in the book or the move doesn't fit it
+    const BookEntry* lookup(Game & game) {
+        if (count == 0) return nullptr;
+        uint64_t key = game.pitch.getKey(game.currentPlayer);
+        const BookEntry *end = entries + count;
+        const BookEntry *entry = lower_bound(entries, end, key, [](const BookEntry & e, uint64_t k) { return e.key < k; });
+        if (entry == end || entry->key != key || !fits(game.pitch, entry->move)) return nullptr;
+        return entry;
+    }
+
+    // sorts the entries by key and writes them as a book file, moves of one key keep their order
+    static bool save(const string & fileName, vector<BookEntry> & entries) {
+        stable_sort(entries.begin(), entries.end(), [](const BookEntry & a, const BookEntry & b) { return a.key < b.key; });
+        BookHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, BOOK_MAGIC, 8);
+        header.version = BOOK_VERSION;
+        header.count = entries.size();
+        header.checksum = fnv1a((const uint8_t*)entries.data(), entries.size() * sizeof(BookEntry));
+        ofstream plik(fileName, ios::out | ios::binary | ios::trunc);
+        plik.write((const char*)&header, sizeof(header));
+        plik.write((const char*)entries.data(), entries.size() * sizeof(BookEntry));
+        return plik.good();
+    }
+
+private:
+    MappedFile file;
+    const BookEntry *entries = nullptr;
+    int count = 0;
+
+    bool fail(const string & fileName, const string & reason) {
+        cerr << "book " << fileName << ": " << reason << endl;
+        return false;
+    }
+
+    // guards against key collisions: every edge of the move has to be free
+    static bool fits(Pitch & pitch, const char *move) {
+        int ball = pitch.ball;
+        for (int i=0; i < BOOK_MOVE && move[i] != 0; i++) {
+            if (move[i] < '0' || move[i] > '7') return false;
+            int n = pitch.nextNode(ball, move[i]);
+            if (n < 0 || n >= pitch.size || pitch.matrix[ball * pitch.size + n] != 1) return false;
+            ball = n;
+        }
+        return move[0] != 0;
+    }
+};
+
+#endif // OPENINGBOOK_H
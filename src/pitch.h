@@ -122,6 +122,7 @@ class Pitch {
 public:
     int ball;
     int size,width,height;
+    uint64_t edgesHash = 0; // xor of edgeKey over the drawn edges, kept by addEdge/removeEdge
 
     vector<uint16_t> matrix;
     vector<uint16_t> matrixNodes;
@@ -250,12 +251,14 @@ public:
         this->height = pitch.height;
         this->size = pitch.size;
         this->ball = pitch.ball;
+        this->edgesHash = pitch.edgesHash;
         this->matrix = pitch.matrix;
         this->matrixNodes = pitch.matrixNodes;
         this->matrixNeighbours = pitch.matrixNeighbours;
     }
 
     void addEdge(int a, int b, int c = NONE) {
+        if ((matrix[a * size + b] & 2) == 0) edgesHash ^= edgeKey(a, b);
         matrix[a * size + b] |= 2;
         matrix[b * size + a] |= 2;
         if (c != NONE) {
@@ -267,6 +270,7 @@ public:
     }
 
     void removeEdge(int a, int b) {
+        if ((matrix[a * size + b] & 2) != 0) edgesHash ^= edgeKey(a, b);
         matrix[a * size + b] = 1;
         matrix[b * size + a] = 1;
         matrixNodes[a]++;
@@ -800,6 +804,16 @@ public:
         return hash;
     }
 
+    uint64_t edgeKey(int a, int b) {
+        uint64_t p = a > b ? ((uint64_t)(a+1) << 16) + (b+1) : ((uint64_t)(b+1) << 16) + (a+1);
+        return murmurHash3(202289 * p);
+    }
+
+    // key of the position for the player to move, O(1) unlike getHash
+    uint64_t getKey(player_t player) {
+        return edgesHash ^ murmurHash3(101 * ball + 1) ^ (player == TWO ? 0x9e3779b97f4a7c15ULL : 0);
+    }
+
     uint64_t murmurHash3(uint64_t x) {
         x ^= x >> 33;
         x *= 0xff51afd7ed558ccdL;
@@ -59,4 +59,12 @@ private:
     uint64_t seed;
 };
 
+// FNV-1a, checksums of sample blocks and weight files; hash continues an earlier one
+inline uint32_t fnv1a(const uint8_t *data, size_t size, uint32_t hash = 2166136261u) {
+    for (size_t i=0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
 #endif // RANDOM_H
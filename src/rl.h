@@ -8,14 +8,108 @@
 #include "negamaxcpu.h"
 #include "network.h"
 #include "random.h"
+#include "samplefile.h"
 
 #include <thread>
 #include <mutex>
 #include <random>
+#include <atomic>
+#include <fstream>
+#include <iostream>
 
 using namespace std;
 using namespace std::chrono;
 
 Network *testNetwork;
 
+// Self-play games with CpuMctsTTR3 engines, one per thread, all sharing the network.
+// Moves are picked by softmax with the given temperature for the first temperatureRounds
+// rounds, then greedily. Every searched position is appended to the output sample file
+// (samplefile.h) and added to the replay memory if there is one.
+class SelfPlay {
+public:
+    INetwork *network;
+    int concurrency = 4;
+    int games = 100;
+    int expansions = 200;
+    double temperature = 3.0;
+    int temperatureRounds = 20;
+    int openingSteps = 2;
+    int poolSize = 1<<20;
+    string outputFile = "samples";
+    ReplayMemory *replay = nullptr; // optional, also receives every sample
+
+    explicit SelfPlay(INetwork *network) : network(network) {}
+
+    void run() {
+        SampleWriter sampleWriter(outputFile);
+        writer = &sampleWriter;
+        start = high_resolution_clock::now();
+        vector<thread> threads;
+        for (int i=0; i < concurrency; i++) {
+            threads.push_back(thread(&SelfPlay::play, this, i));
+        }
+        for (auto & t : threads) t.join();
+        writer = nullptr;
+    }
+
+private:
+    SampleWriter *writer = nullptr;
+    mutex outputLock;
+    atomic<int> nextGame{0};
+    int gamesDone = 0;
+    long positions = 0;
+    high_resolution_clock::time_point start;
+
+    void play(int th) {
+        CpuMctsTTR3 cpu(poolSize);
+        cpu.agent = network;
+        cpu.id = th;
+        Random random(Random().nextLong() ^ (th+1));
+        vector<TrainingSample> samples;
+
+        while (nextGame.fetch_add(1) < games) {
+            samples.clear();
+            Game game;
+            for (int i=0; i < openingSteps; i++) {
+                auto actions = game.getLegalActions();
+                game.makeMove(string(1,'0'+actions[random.nextInt(actions.size())]));
+                if (game.isOver()) break;
+            }
+            if (game.isOver()) continue;
+
+            while (!game.isOver()) {
+                player_t player = game.currentPlayer;
+                if (game.pitch.isNextMoveGameover(player == ONE ? TWO : ONE)) {
+                    game.makeMove(game.pitch.shortWinningMoveForPlayer(player));
+                    continue;
+                }
+                cpu.setGame(&game);
+                cpu.setPlayer(player);
+                cpu.train = game.rounds < temperatureRounds;
+                auto move = cpu.getBestMoveExpansions(expansions, temperature)->move;
+                samples.push_back(TrainingSample::fromGame(game, cpu.rootValue));
+                game.makeMove(move);
+            }
+
+            int winner = game.getWinner();
+            for (auto & sample : samples) {
+                sample.result = sample.player == winner ? 1 : -1;
+            }
+
+            if (replay != nullptr) {
+                for (auto & sample : samples) replay->add(sample);
+            }
+
+            lock_guard<mutex> guard(outputLock);
+            for (auto & sample : samples) writer->add(sample);
+            gamesDone++;
+            positions += samples.size();
+            double hours = duration_cast<milliseconds>(high_resolution_clock::now() - start).count() / 3600000.0;
+            cerr << "games " << gamesDone << " positions " << positions
+                 << " games/hour " << (int)(gamesDone / max(hours, 1e-9)) << endl;
+        }
+    }
+};
+
 #endif // RL_H
@@ -0,0 +1,77 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include "game.h"
+
+using namespace std;
+
+// One position from self-play, 46 bytes. Edges are bits over ALL_EDGES, value is the
+// search value and result the final result, both from the view of the player to move.
+class TrainingSample {
+public:
+    uint8_t edges[40];
+    int16_t value;
+    uint8_t ball;
+    uint8_t player;
+    int8_t result;
+    uint8_t reserved;
+
+    static TrainingSample fromGame(Game & game, float value) {
+        return fromPitch(game.pitch, game.currentPlayer, value);
+    }
+
+    static TrainingSample fromPitch(Pitch & pitch, player_t player, float value) {
+        TrainingSample sample;
+        memset(&sample, 0, sizeof(sample));
+        for (int i=0; i < 316; i++) {
+            if (pitch.existsEdge(ALL_EDGES[i].a,ALL_EDGES[i].b)) {
+                sample.edges[i >> 3] |= 1 << (i & 7);
+            }
+        }
+        sample.value = (int16_t)round(32767.0f * max(-1.0f, min(1.0f, value)));
+        sample.ball = pitch.ball;
+        sample.player = player;
+        return sample;
+    }
+
+    bool hasEdge(int i) const {
+        return (edges[i >> 3] >> (i & 7)) & 1;
+    }
+
+    float getValue() const {
+        return value / 32767.0f;
+    }
+
+    // empty is a fresh Pitch(8,10), copied instead of rebuilding the neighbour lists
+    void toPitch(const Pitch & empty, Pitch & pitch) const {
+        pitch.setPitch(empty);
+        for (int i=0; i < 316; i++) {
+            if (hasEdge(i) && !pitch.existsEdge(ALL_EDGES[i].a,ALL_EDGES[i].b)) {
+                pitch.addEdge(ALL_EDGES[i].a,ALL_EDGES[i].b);
+            }
+        }
+        pitch.ball = ball;
+    }
+
+    // network inputs as chosen by the engines for agent->type
+    vector<int> features(int type, const Pitch & empty) const {
+        Pitch pitch(empty);
+        return features(type, empty, pitch);
+    }
+
+    // same, rebuilding the position in a reusable scratch pitch
+    vector<int> features(int type, const Pitch & empty, Pitch & pitch) const {
+        toPitch(empty, pitch);
+        if (type == 0) return pitch.getTuplesEdges(player);
+        if (type == 1) return pitch.getTuplesEdges3(player);
+        return pitch.getTuplesEdges4(player);
+    }
+};
+
+static_assert(sizeof(TrainingSample) == 46, "TrainingSample must stay packed");
+
+#endif // SAMPLE_H
@@ -0,0 +1,392 @@
+#ifndef SAMPLEFILE_H
+#define SAMPLEFILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "sample.h"
+#include "random.h"
+
+using namespace std;
+
+// Sample file: 16 byte file header, then blocks of up to SAMPLE_BLOCK samples.
+// A block is a BlockHeader and its payload. Compressed payloads are the records XORed with
+// the previous record (positions of one game share most edges), transposed to byte planes
+// and packed with lzCompress. The checksum is over the original records.
+// Files without the header are read as plain TrainingSample records.
+#define SAMPLE_MAGIC "PSSAMPLE"
+#define SAMPLE_VERSION 1
+#define SAMPLE_BLOCK 4096
+#define BLOCK_MAGIC 0x4b425350 // "PSBK"
+
+struct SampleFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t size;
+    uint32_t checksum;
+    uint32_t compressed;
+};
+
+// LZ77 in sequences of: token (literal length << 4 | match length - 4), extra length bytes,
+// literals, 16 bit offset, extra length bytes. The last sequence has literals only.
+void lzWriteLength(vector<uint8_t> & out, size_t length) {
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(length);
+}
+
+void lzCompress(const uint8_t *in, size_t n, vector<uint8_t> & out) {
+    const int HASH_BITS = 14;
+    vector<int32_t> table(1 << HASH_BITS, -1);
+    out.clear();
+    out.reserve(n + n/255 + 16);
+    size_t anchor = 0, i = 0;
+    while (i + 4 <= n) {
+        uint32_t sequence;
+        memcpy(&sequence, in+i, 4);
+        uint32_t h = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        int32_t ref = table[h];
+        table[h] = i;
+        if (ref < 0 || i - ref > 65535 || memcmp(in+ref, in+i, 4) != 0) {
+            i++;
+            continue;
+        }
+        size_t match = 4;
+        while (i + match < n && in[ref+match] == in[i+match]) match++;
+        size_t literals = i - anchor;
+        out.push_back((min<size_t>(literals,15) << 4) | min<size_t>(match-4,15));
+        if (literals >= 15) lzWriteLength(out, literals - 15);
+        out.insert(out.end(), in+anchor, in+i);
+        size_t offset = i - ref;
+        out.push_back(offset & 255);
+        out.push_back(offset >> 8);
+        if (match-4 >= 15) lzWriteLength(out, match - 4 - 15);
+        i += match;
+        anchor = i;
+    }
+    size_t literals = n - anchor;
+    out.push_back(min<size_t>(literals,15) << 4);
+    if (literals >= 15) lzWriteLength(out, literals - 15);
+    out.insert(out.end(), in+anchor, in+n);
+}
+
+// false on corrupted input
+bool lzDecompress(const uint8_t *in, size_t n, vector<uint8_t> & out, size_t expected) {
+    out.clear();
+    out.reserve(expected);
+    const uint8_t *p = in, *end = in + n;
+    auto readLength = [&](size_t length) -> size_t {
+        uint8_t b;
+        do {
+            if (p >= end) return SIZE_MAX;
+            b = *p++;
+            length += b;
+        } while (b == 255);
+        return length;
+    };
+    while (p < end) {
+        uint8_t token = *p++;
+        size_t literals = token >> 4;
+        if (literals == 15 && (literals = readLength(literals)) == SIZE_MAX) return false;
+        if ((size_t)(end - p) < literals || out.size() + literals > expected) return false;
+        out.insert(out.end(), p, p+literals);
+        p += literals;
+        if (p == end) break;
+        if (end - p < 2) return false;
+        size_t offset = p[0] | (p[1] << 8);
+        p += 2;
+        size_t match = token & 15;
+        if (match == 15 && (match = readLength(match)) == SIZE_MAX) return false;
+        match += 4;
+        if (offset == 0 || offset > out.size() || out.size() + match > expected) return false;
+        size_t from = out.size() - offset;
+        for (size_t k=0; k < match; k++) out.push_back(out[from+k]);
+    }
+    return out.size() == expected;
+}
+
+void encodeBlock(const vector<TrainingSample> & samples, bool compress, BlockHeader & header, vector<uint8_t> & payload) {
+    const size_t R = sizeof(TrainingSample);
+    size_t count = samples.size();
+    const uint8_t *records = (const uint8_t*)samples.data();
+    header.magic = BLOCK_MAGIC;
+    header.count = count;
+    header.checksum = fnv1a(records, count * R);
+    header.compressed = compress;
+    if (!compress) {
+        payload.assign(records, records + count * R);
+    } else {
+        vector<uint8_t> planes(count * R);
+        for (size_t r=0; r < count; r++) {
+            for (size_t j=0; j < R; j++) {
+                uint8_t b = records[r*R+j];
+                if (r > 0) b ^= records[(r-1)*R+j];
+                planes[j*count+r] = b;
+            }
+        }
+        lzCompress(planes.data(), planes.size(), payload);
+    }
+    header.size = payload.size();
+}
+
+// false if the block is corrupted
+bool decodeBlock(const BlockHeader & header, const vector<uint8_t> & payload, vector<TrainingSample> & samples) {
+    const size_t R = sizeof(TrainingSample);
+    size_t count = header.count;
+    samples.resize(count);
+    uint8_t *records = (uint8_t*)samples.data();
+    if (!header.compressed) {
+        if (payload.size() != count * R) return false;
+        memcpy(records, payload.data(), count * R);
+    } else {
+        vector<uint8_t> planes;
+        if (!lzDecompress(payload.data(), payload.size(), planes, count * R)) return false;
+        for (size_t r=0; r < count; r++) {
+            for (size_t j=0; j < R; j++) {
+                uint8_t b = planes[j*count+r];
+                if (r > 0) b ^= records[(r-1)*R+j];
+                records[r*R+j] = b;
+            }
+        }
+    }
+    return fnv1a(records, count * R) == header.checksum;
+}
+
+// Appends samples in blocks. Not thread safe, callers serialize add().
+class SampleWriter {
+public:
+    bool compress = true;
+
+    explicit SampleWriter(const string & fileName) {
+        out.open(fileName, ios::binary | ios::app);
+        if (out.tellp() == 0) {
+            SampleFileHeader header;
+            memcpy(header.magic, SAMPLE_MAGIC, 8);
+            header.version = SAMPLE_VERSION;
+            header.recordSize = sizeof(TrainingSample);
+            out.write((const char*)&header, sizeof(header));
+        }
+    }
+
+    virtual ~SampleWriter() {
+        flush();
+    }
+
+    void add(const TrainingSample & sample) {
+        samples.push_back(sample);
+        if (samples.size() >= SAMPLE_BLOCK) flush();
+    }
+
+    void flush() {
+        if (samples.empty()) return;
+        BlockHeader header;
+        encodeBlock(samples, compress, header, payload);
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)payload.data(), payload.size());
+        out.flush();
+        samples.clear();
+    }
+
+private:
+    ofstream out;
+    vector<TrainingSample> samples;
+    vector<uint8_t> payload;
+};
+
+// Network inputs of a batch, sample i uses indexes[offsets[i]..offsets[i+1]).
+class FeatureBatch {
+public:
+    vector<int> indexes;
+    vector<int> offsets;
+    vector<float> values;
+    vector<int8_t> results;
+
+    int size() const {
+        return values.size();
+    }
+
+    void clear() {
+        indexes.clear();
+        offsets.assign(1, 0);
+        values.clear();
+        results.clear();
+    }
+};
+
+// Streams a sample file: one thread reads blocks, decoder threads check and decompress them,
+// shuffle the samples within mixBlocks blocks and turn them into FeatureBatches of the
+// network input type. The queues are bounded, so memory stays flat for any file size.
+class SampleStream {
+public:
+    explicit SampleStream(const string & fileName, int type, int batchSize, int decoders = 2, int mixBlocks = 8)
+        : type(type), batchSize(batchSize), mixBlocks(mixBlocks) {
+        in.open(fileName, ios::binary);
+        if (!in.good()) return;
+        SampleFileHeader header;
+        in.read((char*)&header, sizeof(header));
+        legacy = in.gcount() != sizeof(header) || memcmp(header.magic, SAMPLE_MAGIC, 8) != 0;
+        if (!legacy && (header.version != SAMPLE_VERSION || header.recordSize != sizeof(TrainingSample))) {
+            cerr << "unsupported sample file version " << header.version << endl;
+            return;
+        }
+        if (legacy) {
+            in.clear();
+            in.seekg(0);
+        }
+        opened = true;
+        runningDecoders = decoders;
+        reader = thread(&SampleStream::read, this);
+        for (int i=0; i < decoders; i++) {
+            decoderThreads.push_back(thread(&SampleStream::decode, this));
+        }
+    }
+
+    virtual ~SampleStream() {
+        {
+            lock_guard<mutex> guard(lock);
+            closing = true;
+        }
+        changed.notify_all();
+        if (reader.joinable()) reader.join();
+        for (auto & t : decoderThreads) t.join();
+    }
+
+    bool good() {
+        return opened;
+    }
+
+    // false at the end of the file
+    bool next(FeatureBatch & batch) {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [&]() { return !batches.empty() || runningDecoders == 0; });
+        if (batches.empty()) return false;
+        swap(batch, batches.front());
+        batches.pop_front();
+        changed.notify_all();
+        return true;
+    }
+
+    long corruptedBlocks = 0;
+
+private:
+    ifstream in;
+    int type;
+    int batchSize;
+    int mixBlocks;
+    bool legacy = false;
+    bool opened = false;
+
+    thread reader;
+    vector<thread> decoderThreads;
+    mutex lock;
+    condition_variable changed;
+    deque<pair<BlockHeader,vector<uint8_t>>> blocks;
+    deque<FeatureBatch> batches;
+    bool readDone = false;
+    bool closing = false;
+    int runningDecoders = 0;
+
+    void read() {
+        while (true) {
+            pair<BlockHeader,vector<uint8_t>> block;
+            if (legacy) {
+                block.first.magic = BLOCK_MAGIC;
+                block.first.compressed = 0;
+                block.second.resize(SAMPLE_BLOCK * sizeof(TrainingSample));
+                in.read((char*)block.second.data(), block.second.size());
+                block.first.count = in.gcount() / sizeof(TrainingSample);
+                block.second.resize(block.first.count * sizeof(TrainingSample));
+                block.first.checksum = fnv1a(block.second.data(), block.second.size());
+                if (block.first.count == 0) break;
+            } else {
+                in.read((char*)&block.first, sizeof(BlockHeader));
+                if (in.gcount() != sizeof(BlockHeader)) break;
+                if (block.first.magic != BLOCK_MAGIC || block.first.count > SAMPLE_BLOCK) {
+                    cerr << "broken sample file, stopping at block header" << endl;
+                    break;
+                }
+                block.second.resize(block.first.size);
+                in.read((char*)block.second.data(), block.second.size());
+                if ((size_t)in.gcount() != block.second.size()) break;
+            }
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&]() { return closing || (int)blocks.size() < 2 * mixBlocks; });
+            if (closing) break;
+            blocks.push_back(move(block));
+            changed.notify_all();
+        }
+        lock_guard<mutex> guard(lock);
+        readDone = true;
+        changed.notify_all();
+    }
+
+    void decode() {
+        Pitch empty(8,10), pitch(empty);
+        Random random;
+        vector<TrainingSample> pool, samples;
+        bool more = true;
+        while (more || !pool.empty()) {
+            // fill the pool with mixBlocks blocks, then emit random batches from it
+            while (more && (int)pool.size() < mixBlocks * SAMPLE_BLOCK) {
+                pair<BlockHeader,vector<uint8_t>> block;
+                {
+                    unique_lock<mutex> guard(lock);
+                    changed.wait(guard, [&]() { return closing || !blocks.empty() || readDone; });
+                    if (closing || blocks.empty()) {
+                        more = false;
+                        break;
+                    }
+                    block = move(blocks.front());
+                    blocks.pop_front();
+                    changed.notify_all();
+                }
+                if (!decodeBlock(block.first, block.second, samples)) {
+                    lock_guard<mutex> guard(lock);
+                    corruptedBlocks++;
+                    continue;
+                }
+                pool.insert(pool.end(), samples.begin(), samples.end());
+            }
+
+            FeatureBatch batch;
+            batch.clear();
+            while (batch.size() < batchSize && !pool.empty()) {
+                size_t k = random.nextInt(pool.size());
+                auto & sample = pool[k];
+                auto features = sample.features(type, empty, pitch);
+                batch.indexes.insert(batch.indexes.end(), features.begin(), features.end());
+                batch.offsets.push_back(batch.indexes.size());
+                batch.values.push_back(sample.getValue());
+                batch.results.push_back(sample.result);
+                pool[k] = pool.back();
+                pool.pop_back();
+            }
+            if (batch.size() == 0) continue;
+
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&]() { return closing || (int)batches.size() < 16; });
+            if (closing) break;
+            batches.push_back(move(batch));
+            changed.notify_all();
+        }
+        lock_guard<mutex> guard(lock);
+        runningDecoders--;
+        changed.notify_all();
+    }
+};
+
+#endif // SAMPLEFILE_H
@@ -6,12 +6,15 @@ SecondWindow::SecondWindow(QWidget *parent) :
 {
     ui->setupUi(this);
     QSettings settings("qtpapersoccer.ini", QSettings::IniFormat);
-    int time = settings.value("time", 1).toInt();
+    double time = settings.value("time", 1).toDouble();
     int threads = settings.value("threads", 4).toInt();
     bool comp = settings.value("computer",true).toBool();
     bool kurnikColors = settings.value("kurnikColors", false).toBool();
     bool needToConfirmMoves = settings.value("needToConfirmMoves", true).toBool();
-    ui->timeEdit->setValidator(new QIntValidator(1, 600, this));
+    // seconds per move, fractions allowed (0.5)
+    QDoubleValidator *timeValidator = new QDoubleValidator(0.1, 600, 1, this);
+    timeValidator->setLocale(QLocale::c());
+    ui->timeEdit->setValidator(timeValidator);
     ui->timeEdit->setText(QString::number(time));
     ui->threadEdit->setValidator(new QIntValidator(1, 8, this));
     ui->threadEdit->setText(QString::number(threads));
@@ -40,9 +43,24 @@ void SecondWindow::onStartBtnClicked() {
 }
 
 void SecondWindow::onMoveLogs(const string & logs) {
+    analysisStart = -1;
     ui->textEdit->append(QString::fromStdString(logs));
 }
 
+// replaces the previous update of the same analysis instead of appending
+void SecondWindow::onAnalysis(string text) {
+    QTextCursor cursor(ui->textEdit->document());
+    cursor.movePosition(QTextCursor::End);
+    if (analysisStart < 0) {
+        cursor.insertBlock();
+        analysisStart = cursor.position();
+    } else {
+        cursor.setPosition(analysisStart, QTextCursor::KeepAnchor);
+    }
+    cursor.insertText(QString::fromStdString(text));
+    ui->textEdit->moveCursor(QTextCursor::End);
+}
+
 void SecondWindow::onNotation(string notation) {
     ui->lineEdit->setText(QString::fromStdString(notation));
 }
@@ -7,6 +7,7 @@
 #include <QValidator>
 #include <QThread>
 #include <QSettings>
+#include <QTextCursor>
 
 using namespace std;
 
@@ -25,11 +26,13 @@ public:
 private:
     Ui::SecondWindow *ui;
     int stats[2] = {};
+    int analysisStart = -1; // where the analysis text being updated begins
 
 public slots:
     void onMessage(string message);
     void onStartBtnClicked();
     void onMoveLogs(const string & logs);
+    void onAnalysis(string text);
     void onNotation(string notation);
     void onNotation2(string notation);
     void onGameStateChanged(bool inGame);
@@ -0,0 +1,99 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+#define SNAPSHOT_LINES 8
+
+// One root move of a snapshot. Texts are cut to fit, the move itself is in the search result.
+struct SnapshotLine {
+    char move[128];
+    char pv[512];
+    float winRate;
+    int visits;
+};
+
+// State of a running search as the gui and the protocol show it. Plain data only, so a reader
+// can copy it while the next one is written.
+struct AnalysisSnapshot {
+    int search = 0; // number of the search it comes from, 0 if none yet
+    bool finished = false;
+    long time = 0; // milliseconds
+    int visits = 0;
+    int nodes = 0;
+    long nps = 0;
+    int depth = 0;
+    float evalHits = -1; // percent, -1 without an evaluation cache
+    int lines = 0;
+    SnapshotLine line[SNAPSHOT_LINES];
+
+    void setLine(int i, const string & move, const string & pv, float winRate, int visits) {
+        copyText(line[i].move, move, sizeof(line[i].move));
+        copyText(line[i].pv, pv, sizeof(line[i].pv));
+        line[i].winRate = winRate;
+        line[i].visits = visits;
+    }
+
+    string toString() const {
+        stringstream ss;
+        for (int i=0; i < lines; i++) {
+            ss << line[i].move << ": " << line[i].winRate << "% " << line[i].visits << " | " << line[i].pv << endl;
+        }
+        ss << "visits: " << visits << "  nodes/s: " << nps << "  maxLevel: " << depth << "  time: " << time / 1000.0 << "s" << endl;
+        return ss.str();
+    }
+
+private:
+    static void copyText(char *to, const string & from, size_t size) {
+        size_t n = min(from.size(), size-1);
+        memcpy(to, from.data(), n);
+        to[n] = 0;
+    }
+};
+
+// Latest snapshot, one writer (the search) and any number of readers that never block it. The
+// writer fills the slot that is not published and then switches to it. Each slot has a sequence
+// number, odd while written, so a reader that raced with the writer sees it changed and retries.
+class SnapshotBuffer {
+public:
+    void publish(const AnalysisSnapshot & snapshot) {
+        int next = current.load(memory_order_relaxed) ^ 1;
+        Slot & slot = slots[next];
+        slot.sequence.fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        slot.snapshot = snapshot;
+        slot.sequence.fetch_add(1, memory_order_release);
+        current.store(next, memory_order_release);
+    }
+
+    // false if nothing was published yet or the writer kept overtaking
+    bool read(AnalysisSnapshot & snapshot) {
+        for (int tries=0; tries < 8; tries++) {
+            Slot & slot = slots[current.load(memory_order_acquire)];
+            unsigned before = slot.sequence.load(memory_order_acquire);
+            if (before == 0) return false;
+            if (before & 1) continue;
+            snapshot = slot.snapshot;
+            atomic_thread_fence(memory_order_acquire);
+            if (slot.sequence.load(memory_order_relaxed) == before) return true;
+        }
+        return false;
+    }
+
+private:
+    struct Slot {
+        atomic<unsigned> sequence{0};
+        AnalysisSnapshot snapshot;
+    };
+
+    Slot slots[2];
+    atomic<int> current{0};
+};
+
+#endif // SNAPSHOT_H
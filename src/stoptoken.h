@@ -0,0 +1,30 @@
+#ifndef STOPTOKEN_H
+#define STOPTOKEN_H
+
+#include <atomic>
+
+using namespace std;
+
+// Ends a search from any thread. Every engine checks its token in the search loops and returns
+// the best move found so far. Engines point to their own token, one token can be given to
+// several engines to stop them together. Reset by whoever starts the search, before starting
+// it, so a stop sent in between is not lost.
+class StopToken {
+public:
+    void stop() {
+        flag.store(true, memory_order_relaxed);
+    }
+
+    void reset() {
+        flag.store(false, memory_order_relaxed);
+    }
+
+    bool stopped() const {
+        return flag.load(memory_order_relaxed);
+    }
+
+private:
+    atomic<bool> flag{false};
+};
+
+#endif // STOPTOKEN_H
@@ -0,0 +1,88 @@
+#ifndef TIMEMANAGER_H
+#define TIMEMANAGER_H
+
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+
+using namespace std;
+using namespace std::chrono;
+
+// Time for one search, started before the root is generated so the deadline covers it.
+// Fixed move time: soft and hard limit are the same. Game clock: the soft limit is a share of
+// the remaining time plus most of the increment, the hard limit lets an unstable search go on
+// up to three times longer, never past a quarter of the clock.
+// The search stops at the soft limit (or earlier, see canStopEarly), never after the hard one.
+class TimeManager {
+public:
+    long softLimit = 1000000; // microseconds from start
+    long hardLimit = 1000000;
+    atomic<bool> finished{false};
+    bool earlyStop = true; // may end before the soft limit
+
+    // LONG_MAX is an infinite search, it only ends when stopped
+    void startFixed(long timeInMicro) {
+        start = high_resolution_clock::now();
+        softLimit = hardLimit = max(1L, timeInMicro);
+        earlyStop = timeInMicro != LONG_MAX;
+        finished = false;
+    }
+
+    void startClock(long remainingInMicro, long incrementInMicro, int movesToGo = 30) {
+        start = high_resolution_clock::now();
+        long reserve = min(remainingInMicro / 10, 1000000L); // for lag and the move itself
+        long usable = max(1L, remainingInMicro - reserve);
+        softLimit = min(usable, usable / max(1, movesToGo) + incrementInMicro * 3 / 4);
+        hardLimit = min(max(softLimit, usable / 4), 3 * softLimit);
+        earlyStop = true;
+        finished = false;
+    }
+
+    bool infinite() {
+        return hardLimit == LONG_MAX;
+    }
+
+    long elapsed() {
+        return duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    }
+
+    bool pastSoft() {
+        return elapsed() >= softLimit;
+    }
+
+    bool pastHard() {
+        return elapsed() >= hardLimit;
+    }
+
+    // every thread stops when this is true
+    bool done() {
+        return finished || pastHard();
+    }
+
+    void finish() {
+        finished = true;
+    }
+
+    // visits still expected before the soft limit at the rate so far
+    long expectedVisits(long visits) {
+        long e = elapsed();
+        if (e <= 0 || e >= softLimit) return 0;
+        return (long)((double)visits * (softLimit - e) / e);
+    }
+
+    // Not before a tenth of the soft limit, when the rate is still unreliable. leaderScore and
+    // runnerUpScore are as in the final choice, heuristic + log(games+3): true when the runner-up
+    // stays behind even if it got all the remaining visits.
+    bool canStopEarly(long visits, float leaderScore, float runnerUpScore, int runnerUpGames) {
+        if (!earlyStop || elapsed() < softLimit / 10) return false;
+        long more = expectedVisits(visits);
+        return leaderScore - runnerUpScore > log(runnerUpGames + more + 3.0) - log(runnerUpGames + 3.0);
+    }
+
+private:
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+};
+
+#endif // TIMEMANAGER_H
@@ -0,0 +1,155 @@
+#ifndef TRAINER_H
+#define TRAINER_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include "network.h"
+#include "samplefile.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// Mini-batch trainer. Batches come already decoded from a SampleStream. Every batch is split
+// between threads started once per training: the sparse first layer is updated in place without
+// locks, the dense layers get per-thread gradients that are summed and applied once per batch.
+// Target is lambda * result + (1 - lambda) * search value.
+class Trainer {
+public:
+    Network *network;
+    int threads = 4;
+    int batchSize = 1024;
+    float lambda = 0.5f;
+    int epochs = 1;
+    int decoders = 2;
+    int reportInterval = 100; // batches
+
+    explicit Trainer(Network *network) : network(network) {}
+
+    void train(const string & sampleFile, const string & outputName) {
+        gradHidden2.assign(threads, vector<float>(network->hiddenWeights2Size()));
+        gradOutput.assign(threads, vector<float>(network->outputWeights.size()));
+        scratch.assign(threads, BackpropScratch());
+        errors.assign(threads, 0);
+        startWorkers();
+
+        FeatureBatch batch;
+        auto start = high_resolution_clock::now();
+        long samples = 0;
+        for (int epoch=0; epoch < epochs; epoch++) {
+            SampleStream stream(sampleFile, network->type, batchSize, decoders);
+            if (!stream.good()) {
+                cerr << "cannot read " << sampleFile << endl;
+                break;
+            }
+            double error = 0;
+            long errorSamples = 0;
+            int batches = 0;
+            while (stream.next(batch)) {
+                error += trainBatch(batch);
+                errorSamples += batch.size();
+                samples += batch.size();
+                if (++batches % reportInterval == 0) {
+                    report(epoch, samples, error / errorSamples, start);
+                    error = 0;
+                    errorSamples = 0;
+                }
+            }
+            if (errorSamples > 0) report(epoch, samples, error / errorSamples, start);
+            network->save(outputName);
+        }
+        stopWorkers();
+    }
+
+private:
+    vector<vector<float>> gradHidden2;
+    vector<vector<float>> gradOutput;
+    vector<BackpropScratch> scratch;
+    vector<double> errors;
+
+    // workers wait for the next batch number, the last one done wakes trainBatch
+    vector<thread> workers;
+    mutex lock;
+    condition_variable changed;
+    const FeatureBatch *current = nullptr;
+    long batchNumber = 0;
+    int running = 0;
+    bool closing = false;
+
+    void startWorkers() {
+        closing = false;
+        batchNumber = 0;
+        for (int th=0; th < threads; th++) {
+            workers.push_back(thread(&Trainer::work, this, th));
+        }
+    }
+
+    void stopWorkers() {
+        {
+            lock_guard<mutex> guard(lock);
+            closing = true;
+        }
+        changed.notify_all();
+        for (auto & w : workers) w.join();
+        workers.clear();
+    }
+
+    void work(int th) {
+        long done = 0;
+        while (true) {
+            {
+                unique_lock<mutex> guard(lock);
+                changed.wait(guard, [&]() { return closing || batchNumber > done; });
+                if (closing) return;
+                done = batchNumber;
+            }
+            const FeatureBatch & batch = *current;
+            auto & g2 = gradHidden2[th];
+            auto & g = gradOutput[th];
+            fill(g2.begin(), g2.end(), 0.0f);
+            fill(g.begin(), g.end(), 0.0f);
+            errors[th] = 0;
+            int n = batch.size();
+            for (int i = th*n/threads; i < (th+1)*n/threads; i++) {
+                float target = lambda * batch.results[i] + (1-lambda) * batch.values[i];
+                int start = batch.offsets[i];
+                errors[th] += network->backprop(&batch.indexes[start], batch.offsets[i+1] - start, target, scratch[th], g2, g);
+            }
+            lock_guard<mutex> guard(lock);
+            if (--running == 0) changed.notify_all();
+        }
+    }
+
+    void report(int epoch, long samples, double loss, high_resolution_clock::time_point start) {
+        double seconds = duration_cast<milliseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+        cout << "epoch " << (epoch+1) << " samples " << samples << " loss " << loss
+             << " samples/sec " << (long)(samples / max(seconds, 1e-3)) << endl;
+    }
+
+    // returns the summed squared error of the batch
+    double trainBatch(const FeatureBatch & batch) {
+        {
+            unique_lock<mutex> guard(lock);
+            current = &batch;
+            running = threads;
+            batchNumber++;
+            changed.notify_all();
+            changed.wait(guard, [&]() { return running == 0; });
+        }
+
+        for (int th=1; th < threads; th++) {
+            for (size_t i=0; i < gradHidden2[0].size(); i++) gradHidden2[0][i] += gradHidden2[th][i];
+            for (size_t i=0; i < gradOutput[0].size(); i++) gradOutput[0][i] += gradOutput[th][i];
+        }
+        network->applyGradients(gradHidden2[0], gradOutput[0]);
+
+        double error = 0;
+        for (auto & e : errors) error += e;
+        return error;
+    }
+};
+
+#endif // TRAINER_H
@@ -1,41 +1,137 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-#include <deque>
 #include <vector>
+#include <atomic>
+#include <memory>
 #include <cstdint>
+#include <cstring>
+#include <string>
+#include "random.h"
+#include "sample.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 using namespace std;
 
-class LimitedCapacityQueue {
+// Replay memory of fixed capacity, the newest samples overwrite the oldest.
+// Samples are stored contiguously with a fixed stride. add() claims a slot with an atomic
+// counter and publishes it through a per-slot sequence number (odd while writing), so self-play
+// threads never wait for each other or for readers. sample() copies random slots and retries
+// the ones being overwritten. With a file name the storage is a shared mmap of that file and
+// the samples survive restarts.
+class ReplayMemory {
 public:
-    size_t size;
-
-    explicit LimitedCapacityQueue(size_t size) : size(size) {
-
+    explicit ReplayMemory(size_t capacity, const string & fileName = "") : capacity(capacity), sequences(new atomic<uint32_t>[capacity]) {
+        for (size_t i=0; i < capacity; i++) sequences[i] = 0;
+        if (!fileName.empty() && mapFile(fileName)) return;
+        storage.resize(capacity);
+        records = storage.data();
+        head = &localHead;
     }
 
-    void add(pair<vector<int16_t>,float> element) {
-        if (deq.size() >= size) {
-            deq.pop_front();
+    virtual ~ReplayMemory() {
+#ifndef _WIN32
+        if (mapped != nullptr) {
+            msync(mapped, mappedSize, MS_ASYNC);
+            munmap(mapped, mappedSize);
         }
-        deq.push_back(element);
+#endif
     }
 
-    void clear() {
-        deq.clear();
+    void add(const TrainingSample & sample) {
+        size_t slot = head->fetch_add(1) % capacity;
+        auto & sequence = sequences[slot];
+        uint32_t s = sequence.load(memory_order_relaxed);
+        while ((s & 1) || !sequence.compare_exchange_weak(s, s+1, memory_order_acquire)) {
+            s = sequence.load(memory_order_relaxed);
+        }
+        memcpy(&records[slot], &sample, sizeof(TrainingSample));
+        sequence.store(s+2, memory_order_release);
     }
 
-    int getSize() {
-        return deq.size();
+    size_t size() {
+        return min<uint64_t>(head->load(), capacity);
     }
 
-    vector<pair<vector<int16_t>,float>> toVector() {
-        return vector<pair<vector<int16_t>,float>>(deq.begin(),deq.end());
+    // copies count random samples into batch, which is only allocated once by the caller
+    void sample(vector<TrainingSample> & batch, size_t count, Random & random) {
+        batch.resize(count);
+        size_t n = size();
+        if (n == 0) {
+            batch.clear();
+            return;
+        }
+        // a slot claimed by add but not yet written is skipped for another one
+        for (auto & b : batch) {
+            while (!read(random.nextLong() % n, b)) { }
+        }
     }
 
 private:
-    deque<pair<vector<int16_t>,float>> deq;
+    struct Header {
+        char magic[8];
+        uint64_t capacity;
+        atomic<uint64_t> head;
+        char reserved[40];
+    };
+
+    const size_t capacity;
+    unique_ptr<atomic<uint32_t>[]> sequences;
+    vector<TrainingSample> storage;
+    TrainingSample *records;
+    atomic<uint64_t> localHead{0};
+    atomic<uint64_t> *head;
+    void *mapped = nullptr;
+    size_t mappedSize = 0;
+
+    // false while the slot is written or before its first sample
+    bool read(size_t slot, TrainingSample & out) {
+        auto & sequence = sequences[slot];
+        uint32_t s1 = sequence.load(memory_order_acquire);
+        if (s1 == 0 || (s1 & 1)) return false;
+        memcpy(&out, &records[slot], sizeof(TrainingSample));
+        atomic_thread_fence(memory_order_acquire);
+        return sequence.load(memory_order_relaxed) == s1;
+    }
+
+    // maps the file, a file of another capacity is started from scratch
+    bool mapFile(const string & fileName) {
+#ifndef _WIN32
+        int fd = open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return false;
+        mappedSize = sizeof(Header) + capacity * sizeof(TrainingSample);
+        off_t oldSize = lseek(fd, 0, SEEK_END);
+        if ((size_t)oldSize != mappedSize && ftruncate(fd, mappedSize) != 0) {
+            close(fd);
+            return false;
+        }
+        mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            mapped = nullptr;
+            return false;
+        }
+        Header *header = (Header*)mapped;
+        if ((size_t)oldSize != mappedSize || memcmp(header->magic, "PSREPLAY", 8) != 0 || header->capacity != capacity) {
+            memcpy(header->magic, "PSREPLAY", 8);
+            header->capacity = capacity;
+            header->head = 0;
+        }
+        head = &header->head;
+        records = (TrainingSample*)((char*)mapped + sizeof(Header));
+        // the samples kept in the file are complete
+        for (size_t i=0; i < size(); i++) sequences[i] = 2;
+        return true;
+#else
+        (void)fileName;
+        return false;
+#endif
+    }
 };
 
 #endif // UTILS_H
@@ -5,16 +5,22 @@ void WorkerThread::run() {
     int threads = settings.value("threads", 4).toInt();
     if (threads < 1) threads = 1;
     if (threads > 8) threads = 8;
-    int time = settings.value("time", 1).toInt();
-    if (time == 0) time = 1;
+    double time = settings.value("time", 1).toDouble();
+    if (time <= 0) time = 1;
     cpu->ss = std::stringstream();
     string move;
-    if (game->pitch.isNextMoveGameover(cpu->getPlayer()==ONE?TWO:ONE)) {
+    const BookEntry *entry = infinite || book == nullptr ? nullptr : book->lookup(*game);
+    if (entry != nullptr) {
+        move = entry->move;
+        stringstream logs;
+        logs << "book move " << move << ": " << entry->winRate << "% " << entry->visits;
+        emit moveLogs(logs.str());
+    } else if (game->pitch.isNextMoveGameover(cpu->getPlayer()==ONE?TWO:ONE)) {
         move = game->pitch.shortWinningMoveForPlayer(cpu->getPlayer());
         string logs = "short winning move "+move;
         emit moveLogs(logs);
     } else {
-        move = cpu->getBestMove(time * 1000000L, threads)->move;
+        move = cpu->getBestMove(infinite ? LONG_MAX : (long)(time * 1000000), threads)->move;
         emit moveLogs(cpu->ss.str());
     }
 
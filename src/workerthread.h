@@ -6,6 +6,7 @@
 #include <QSettings>
 #include "game.h"
 #include "cpumctstt.h"
+#include "openingbook.h"
 
 using namespace std;
 
@@ -13,7 +14,9 @@ class WorkerThread : public QThread
 {
     Q_OBJECT
 public:
-    WorkerThread(Game *game, CpuMctsTTRParallel* cpu) : cpu(cpu) {
+    // infinite searches until cpu->stop(), then plays the best move; otherwise a book move is
+    // played without searching
+    WorkerThread(Game *game, CpuMctsTTRParallel* cpu, bool infinite = false, OpeningBook *book = nullptr) : cpu(cpu), infinite(infinite), book(book) {
         this->game.reset(new Game(*game));
         cpu->setGame(this->game.get());
     }
@@ -22,6 +25,8 @@ public:
 private:
     shared_ptr<Game> game;
     CpuMctsTTRParallel* cpu;
+    bool infinite;
+    OpeningBook *book;
 
 signals:
     void moveCalculated(char c);